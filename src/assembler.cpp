@@ -0,0 +1,805 @@
+#include "assembler.h"
+
+#include <cstdarg>
+#include <string>
+#include <unordered_map>
+
+#include "jumps.h"
+#include "encoder.h"
+
+#define ASSEMBLER_MAX_PASSES 8
+
+enum struct Token_Kind : u8 { End, Number, Identifier, Symbol, Here, SectionStart, Invalid };
+
+struct Token {
+	Token_Kind kind;
+	char symbol;
+	String_View text;
+	i64 number;
+};
+
+static bool isIdentifierStart(char const c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.' || c == '?' || c == '@';
+}
+
+static bool isIdentifierChar(char const c) {
+	return isIdentifierStart(c) || (c >= '0' && c <= '9') || c == '$' || c == '#' || c == '~';
+}
+
+static bool equalsNoCase(String_View const& a, const char* b) {
+	size_t const len = strlen(b);
+	if (a.count != len) return false;
+	for (size_t i = 0; i < len; i++) {
+		char const c = (a.items[i] >= 'A' && a.items[i] <= 'Z') ? cast(char)(a.items[i] - 'A' + 'a') : a.items[i];
+		if (c != b[i]) return false;
+	}
+	return true;
+}
+
+// Decimal, 0x/0h hex, 0b binary or nasm's hex with an h at the end. Underscores are ignored.
+static bool parseNumber(String_View const& text, i64& out) {
+	u32 base = 10;
+	size_t start = 0, end = text.count;
+	if (text.count > 2 && text.items[0] == '0' && (text.items[1] == 'x' || text.items[1] == 'X')) {
+		base = 16, start = 2;
+	} else if (text.count > 2 && text.items[0] == '0' && (text.items[1] == 'b' || text.items[1] == 'B')) {
+		base = 2, start = 2;
+	} else if (text.count > 1 && (text.items[end - 1] == 'h' || text.items[end - 1] == 'H')) {
+		base = 16, end--;
+	}
+	if (start >= end) return false;
+
+	u64 value = 0;
+	for (size_t i = start; i < end; i++) {
+		char const c = text.items[i];
+		u32 digit;
+		if      (c >= '0' && c <= '9') digit = c - '0';
+		else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+		else if (c == '_') continue;
+		else return false;
+		if (digit >= base) return false;
+		value = value * base + digit;
+		if (value > 0xFFFFFFFF) return false;
+	}
+	out = cast(i64)value;
+	return true;
+}
+
+struct Asm_Lexer {
+	const char* at;
+	const char* end;
+
+	explicit Asm_Lexer(String_View const& line): at(line.items), end(line.items + line.count) {}
+
+	Token next() {
+		while (at < end && String_View::isWhitespace(*at)) at++;
+		Token token = {.kind = Token_Kind::End, .symbol = 0, .text = String_View(at, 0), .number = 0};
+		if (at >= end) return token;
+
+		const char* const start = at;
+		if (*at == '$' && at + 1 < end && at[1] == '$') {
+			at += 2;
+			token.kind = Token_Kind::SectionStart;
+		} else if (*at == '$' && !(at + 1 < end && isIdentifierStart(at[1]))) {
+			at++;
+			token.kind = Token_Kind::Here;
+		} else if (*at >= '0' && *at <= '9') {
+			while (at < end && isIdentifierChar(*at)) at++;
+			token.kind = parseNumber(String_View(start, at - start), token.number) ? Token_Kind::Number : Token_Kind::Invalid;
+		} else if (isIdentifierStart(*at) || *at == '$') {
+			if (*at == '$') at++;  // nasm's way of using a reserved word as a label.
+			while (at < end && isIdentifierChar(*at)) at++;
+			token.kind = Token_Kind::Identifier;
+		} else if (strchr("+-*/%()[],:~", *at) != nullptr) {
+			token.kind = Token_Kind::Symbol;
+			token.symbol = *at++;
+		} else {
+			at++;
+			token.kind = Token_Kind::Invalid;
+		}
+		token.text = String_View(start, at - start);
+		if (token.kind == Token_Kind::Identifier && *start == '$') {
+			token.text.advance(1);
+		}
+		return token;
+	}
+
+	Token peek() {
+		const char* const saved = at;
+		Token const token = next();
+		at = saved;
+		return token;
+	}
+
+	bool nextIsSymbol(char const symbol) {
+		Token const token = peek();
+		return token.kind == Token_Kind::Symbol && token.symbol == symbol;
+	}
+};
+
+static bool parseRegisterName(String_View const& name, RegisterInfo& out) {
+	for (u8 id = 0; id < RegisterCount; id++) {
+		if (id == RegToID(Register::ip) || id == RegToID(Register::fl)) continue;
+		if (equalsNoCase(name, RegisterNames[id])) {
+			out = RegisterList[id];
+			return true;
+		}
+	}
+	for (u8 i = 0; i < StaticArrayCount(RegisterExtraNames); i++) {
+		if (equalsNoCase(name, RegisterExtraNames[i])) {
+			out = RegisterInfo{.type = IDToReg(i / 2), .usage = (i % 2 == 0) ? RegisterUsage::h : RegisterUsage::l};
+			return true;
+		}
+	}
+	return false;
+}
+
+struct Mnemonic_Alias {
+	const char* name;
+	Instruction_Type type;
+};
+
+// Other names nasm accepts for the instructions in instructions.inl.
+constexpr Mnemonic_Alias mnemonicAliases[] = {
+	{"jz", Inst_je},    {"jnz", Inst_jne},   {"jc", Inst_jb},      {"jnae", Inst_jb},
+	{"jnc", Inst_jnb},  {"jae", Inst_jnb},   {"jna", Inst_jbe},    {"jnbe", Inst_ja},
+	{"jpe", Inst_jp},   {"jpo", Inst_jnp},   {"jnge", Inst_jl},    {"jge", Inst_jnl},
+	{"jng", Inst_jle},  {"jnle", Inst_jg},   {"loopne", Inst_loopnz}, {"loope", Inst_loopz},
+	{"sal", Inst_shl},
+};
+
+static Instruction_Type lookupMnemonic(String_View const& name) {
+	for (u8 type = Inst_None + 1; type < Inst_Count; type++) {
+		if (equalsNoCase(name, Instruction_Mnemonics[type])) return cast(Instruction_Type)type;
+	}
+	for (Mnemonic_Alias const& alias: mnemonicAliases) {
+		if (equalsNoCase(name, alias.name)) return alias.type;
+	}
+	return Inst_None;
+}
+
+// The base and index registers an effective address was written with.
+enum EA_Register : u8 { EA_bx = 1 << 0, EA_bp = 1 << 1, EA_si = 1 << 2, EA_di = 1 << 3 };
+
+static bool getEARegister(RegisterInfo const& reg, u8& out) {
+	if (reg.usage != RegisterUsage::x) return false;
+	switch (reg.type) {
+		case Register::b:  out = EA_bx; return true;
+		case Register::bp: out = EA_bp; return true;
+		case Register::si: out = EA_si; return true;
+		case Register::di: out = EA_di; return true;
+		default: return false;
+	}
+}
+
+// Returns false for combinations the 8086 can't address, like [bx + bp].
+static bool getEAR_M(u8 const registers, u8& R_M) {
+	EffectiveAddress::Base base;
+	switch (registers) {
+		case EA_bx | EA_si: base = EffectiveAddress::Base::bx_si; break;
+		case EA_bx | EA_di: base = EffectiveAddress::Base::bx_di; break;
+		case EA_bp | EA_si: base = EffectiveAddress::Base::bp_si; break;
+		case EA_bp | EA_di: base = EffectiveAddress::Base::bp_di; break;
+		case EA_si:         base = EffectiveAddress::Base::si;    break;
+		case EA_di:         base = EffectiveAddress::Base::di;    break;
+		case EA_bp:         base = EffectiveAddress::Base::bp;    break;
+		case EA_bx:         base = EffectiveAddress::Base::bx;    break;
+		default: return false;
+	}
+	R_M = getEffectiveAddressR_M(base);
+	return true;
+}
+
+// Whether nasm would store the value as a sign extended byte, values are
+// taken modulo 2^16 like the 8086 does.
+static bool fitsSignedByte(i64 const value) {
+	i16 const word = signExtendWord(value & 0xFFFF);
+	return word >= -128 && word <= 127;
+}
+
+struct Expr_Value {
+	i64 value;
+	u8 registers;  // EA_Register bits, only inside brackets.
+	bool known;    // False if it used a label that isn't defined yet.
+};
+
+enum struct Asm_Operand_Kind : u8 { None, Register, Memory, Immediate };
+
+struct Asm_Operand {
+	Asm_Operand_Kind kind;
+	Instruction_Operand_Prefix size;  // From a byte/word prefix or from the register.
+	RegisterInfo reg;
+	u8 eaRegisters;
+	i64 value;  // The displacement of a memory operand.
+	bool known;
+};
+
+#define IsAsmReg(op) ((op).kind == Asm_Operand_Kind::Register)
+#define IsAsmMem(op) ((op).kind == Asm_Operand_Kind::Memory)
+#define IsAsmImm(op) ((op).kind == Asm_Operand_Kind::Immediate)
+#define IsAsmRegMem(op) (IsAsmReg(op) || IsAsmMem(op))
+#define IsAsmSegment(op) (IsAsmReg(op) && IsRegisterSegment((op).reg))
+#define IsAsmAccumulator(op) (IsAsmReg(op) && (op).reg.type == Register::a)
+#define IsAsmDirectAddress(op) (IsAsmMem(op) && (op).eaRegisters == 0)
+
+// Short jumps reach labels further down, so sizes and labels are worked out
+// by assembling everything again until no label moves. Errors that depend on
+// where labels are (undefined labels, values out of range) are only reported
+// for the last pass, anything else stops right away.
+struct Assembler {
+	struct Label {
+		i64 value;
+		u32 pass;
+	};
+
+	std::unordered_map<std::string, Label> labels;
+	std::vector<u8> bytes;
+	std::string scope;  // The last label not starting with '.', what local labels are part of.
+	u32 pass = 0;
+	u32 line = 0;
+	i64 here = 0;       // Offset of the instruction being assembled, what `$` means.
+	bool labelsChanged = false;
+	bool hasDeferredError = false;
+	Assembler_Error deferredError = {};
+	Assembler_Error error = {};
+
+	bool fail(const char* fmt, ...) {
+		va_list args;
+		va_start(args, fmt);
+		error.line = line;
+		vsnprintf(error.message, sizeof(error.message), fmt, args);
+		va_end(args);
+		return false;
+	}
+
+	// Carries on, the error might be gone once the labels settle.
+	void failLater(const char* fmt, ...) {
+		if (hasDeferredError) return;
+		hasDeferredError = true;
+		va_list args;
+		va_start(args, fmt);
+		deferredError.line = line;
+		vsnprintf(deferredError.message, sizeof(deferredError.message), fmt, args);
+		va_end(args);
+	}
+
+	void emit08(i64 const value) {
+		bytes.push_back(cast(u8)(value & 0xFF));
+	}
+
+	void emit16(i64 const value) {
+		emit08(value);
+		emit08(value >> 8);
+	}
+
+	std::string getLabelName(String_View const& name) const {
+		std::string result = (name.items[0] == '.') ? scope : std::string();
+		result.append(name.items, name.count);
+		return result;
+	}
+
+	bool defineLabel(String_View const& name) {
+		std::string const fullName = getLabelName(name);
+		if (name.items[0] != '.') {
+			scope = fullName;
+		}
+		auto [it, inserted] = labels.try_emplace(fullName, Label{.value = here, .pass = pass});
+		if (!inserted) {
+			if (it->second.pass == pass) {
+				return fail("The label '%s' is defined more than once.", fullName.c_str());
+			}
+			labelsChanged |= it->second.value != here;
+			it->second = {.value = here, .pass = pass};
+		} else {
+			labelsChanged = true;
+		}
+		return true;
+	}
+
+	// Expressions
+	// ------------------------------------------------------------------------------------------------------ //
+
+	bool parsePrimary(Asm_Lexer& lexer, Expr_Value& out, bool const allowRegisters) {
+		Token const token = lexer.next();
+		out = {.value = 0, .registers = 0, .known = true};
+		switch (token.kind) {
+			case Token_Kind::Number:       out.value = token.number; return true;
+			case Token_Kind::Here:         out.value = here;         return true;
+			case Token_Kind::SectionStart: out.value = 0;            return true;
+			case Token_Kind::Identifier: {
+				RegisterInfo reg;
+				if (parseRegisterName(token.text, reg)) {
+					if (!allowRegisters || !getEARegister(reg, out.registers)) {
+						return fail("The register '%.*s' can't be used in an expression.", cast(int)token.text.count, token.text.items);
+					}
+					return true;
+				}
+				std::string const name = getLabelName(token.text);
+				if (auto const it = labels.find(name); it != labels.end()) {
+					out.value = it->second.value;
+				} else {
+					out.known = false;
+					failLater("The label '%s' is not defined.", name.c_str());
+				}
+				return true;
+			}
+			case Token_Kind::Symbol: {
+				if (token.symbol == '(') {
+					if (!parseSum(lexer, out, allowRegisters)) return false;
+					if (!lexer.nextIsSymbol(')')) return fail("Expected ')'.");
+					lexer.next();
+					return true;
+				}
+				break;
+			}
+			default: break;
+		}
+		if (token.kind == Token_Kind::End) {
+			return fail("Expected an expression.");
+		}
+		return fail("Unexpected '%.*s' in an expression.", cast(int)token.text.count, token.text.items);
+	}
+
+	bool parseUnary(Asm_Lexer& lexer, Expr_Value& out, bool const allowRegisters) {
+		if (lexer.nextIsSymbol('-') || lexer.nextIsSymbol('+') || lexer.nextIsSymbol('~')) {
+			char const op = lexer.next().symbol;
+			if (!parseUnary(lexer, out, false)) return false;
+			if (op == '-') out.value = -out.value;
+			if (op == '~') out.value = ~out.value;
+			return true;
+		}
+		return parsePrimary(lexer, out, allowRegisters);
+	}
+
+	bool parseProduct(Asm_Lexer& lexer, Expr_Value& out, bool const allowRegisters) {
+		if (!parseUnary(lexer, out, allowRegisters)) return false;
+		while (lexer.nextIsSymbol('*') || lexer.nextIsSymbol('/') || lexer.nextIsSymbol('%')) {
+			char const op = lexer.next().symbol;
+			Expr_Value rhs;
+			if (!parseUnary(lexer, rhs, false)) return false;
+			if (out.registers) return fail("Registers in an effective address can only be added.");
+			out.known &= rhs.known;
+			if (op == '*') {
+				out.value *= rhs.value;
+			} else if (rhs.value != 0) {
+				out.value = (op == '/') ? out.value / rhs.value : out.value % rhs.value;
+			} else if (rhs.known) {
+				return fail("Division by zero.");
+			}
+		}
+		return true;
+	}
+
+	bool parseSum(Asm_Lexer& lexer, Expr_Value& out, bool const allowRegisters) {
+		if (!parseProduct(lexer, out, allowRegisters)) return false;
+		while (lexer.nextIsSymbol('+') || lexer.nextIsSymbol('-')) {
+			char const op = lexer.next().symbol;
+			Expr_Value rhs;
+			if (!parseProduct(lexer, rhs, allowRegisters && op == '+')) return false;
+			if (out.registers & rhs.registers) return fail("A register is used twice in an effective address.");
+			out.registers |= rhs.registers;
+			out.known &= rhs.known;
+			out.value = (op == '+') ? out.value + rhs.value : out.value - rhs.value;
+		}
+		return true;
+	}
+
+	// Operands
+	// ------------------------------------------------------------------------------------------------------ //
+
+	bool parseOperand(Asm_Lexer& lexer, Asm_Operand& out) {
+		out = {.kind = Asm_Operand_Kind::None, .size = Instruction_Operand_Prefix::None, .known = true};
+		for (Token token = lexer.peek(); token.kind == Token_Kind::Identifier; token = lexer.peek()) {
+			if (equalsNoCase(token.text, "byte")) {
+				out.size = Instruction_Operand_Prefix::Byte;
+			} else if (equalsNoCase(token.text, "word")) {
+				out.size = Instruction_Operand_Prefix::Word;
+			} else if (equalsNoCase(token.text, "short")) {
+				// Every jump the 8086 has here is short already.
+			} else if (equalsNoCase(token.text, "near") || equalsNoCase(token.text, "far") || equalsNoCase(token.text, "dword")) {
+				return fail("'%.*s' operands are not supported.", cast(int)token.text.count, token.text.items);
+			} else {
+				break;
+			}
+			lexer.next();
+		}
+
+		Token const token = lexer.peek();
+		if (token.kind == Token_Kind::Symbol && token.symbol == '[') {
+			lexer.next();
+			Asm_Lexer afterName = lexer;
+			if (RegisterInfo reg; parseRegisterName(afterName.next().text, reg) && afterName.nextIsSymbol(':')) {
+				return fail("Segment overrides are not supported.");
+			}
+			Expr_Value address;
+			if (!parseSum(lexer, address, true)) return false;
+			if (!lexer.nextIsSymbol(']')) return fail("Expected ']' after the effective address.");
+			lexer.next();
+
+			out.kind = Asm_Operand_Kind::Memory;
+			out.eaRegisters = address.registers;
+			out.value = address.value;
+			out.known = address.known;
+			if (u8 R_M; address.registers != 0 && !getEAR_M(address.registers, R_M)) {
+				return fail("Invalid effective address, the 8086 can only add one of bx/bp to one of si/di.");
+			}
+			if (address.known && (address.value < -32768 || address.value > 0xFFFF)) {
+				failLater("The displacement %lld doesn't fit in 16 bits.", cast(long long)address.value);
+			}
+			return true;
+		}
+
+		if (RegisterInfo reg; token.kind == Token_Kind::Identifier && parseRegisterName(token.text, reg)) {
+			lexer.next();
+			if (lexer.nextIsSymbol(':')) return fail("Segment overrides are not supported.");
+			Instruction_Operand_Prefix const size = MakeInstPrefix(reg.usage == RegisterUsage::x);
+			if (out.size != Instruction_Operand_Prefix::None && out.size != size) {
+				return fail("Mismatch in operand sizes.");
+			}
+			out.kind = Asm_Operand_Kind::Register;
+			out.size = size;
+			out.reg = reg;
+			return true;
+		}
+
+		Expr_Value value;
+		if (!parseSum(lexer, value, false)) return false;
+		out.kind = Asm_Operand_Kind::Immediate;
+		out.value = value.value;
+		out.known = value.known;
+		return true;
+	}
+
+	// Whether the instruction works on words, from whichever operands have a size.
+	bool getWidth(Asm_Operand const& dst, Asm_Operand const& src, bool& wide) {
+		Instruction_Operand_Prefix size = dst.size;
+		if (src.size != Instruction_Operand_Prefix::None) {
+			if (size != Instruction_Operand_Prefix::None && size != src.size) {
+				return fail("Mismatch in operand sizes.");
+			}
+			size = src.size;
+		}
+		if (size == Instruction_Operand_Prefix::None) {
+			return fail("Operation size not specified, it needs a byte or word prefix.");
+		}
+		wide = size == Instruction_Operand_Prefix::Word;
+		return true;
+	}
+
+	// The ModRM byte and displacement for a register or memory operand.
+	void emitModRM(Asm_Operand const& rm, u8 const REG) {
+		if (IsAsmReg(rm)) {
+			emit08(0b11 << 6 | REG << 3 | getRegisterEncoding(rm.reg));
+			return;
+		}
+		assertTrue(IsAsmMem(rm));
+		if (rm.eaRegisters == 0) {
+			emit08(0b00 << 6 | REG << 3 | 0b110);
+			emit16(rm.value);
+			return;
+		}
+		u8 R_M;
+		bool const valid = getEAR_M(rm.eaRegisters, R_M);
+		assertTrue(valid);
+		if (rm.known && rm.value == 0 && !is_Effective_Address_Direct(0b00, R_M)) {
+			emit08(0b00 << 6 | REG << 3 | R_M);
+		} else if (rm.known && fitsSignedByte(rm.value)) {
+			emit08(0b01 << 6 | REG << 3 | R_M);
+			emit08(rm.value);
+		} else {
+			emit08(0b10 << 6 | REG << 3 | R_M);
+			emit16(rm.value);
+		}
+	}
+
+	// signExtended: Only store the low byte of a word, the 8086 sign extends it back.
+	void emitImmediate(Asm_Operand const& imm, bool const wide, bool const signExtended = false) {
+		if (imm.known && (wide ? (imm.value < -32768 || imm.value > 0xFFFF) : (imm.value < -128 || imm.value > 0xFF))) {
+			failLater("The value %lld doesn't fit in a %s.", cast(long long)imm.value, wide ? "word" : "byte");
+		}
+		if (wide && !signExtended) emit16(imm.value);
+		else                       emit08(imm.value);
+	}
+
+	// Instructions
+	// ------------------------------------------------------------------------------------------------------ //
+
+	bool encodeMov(Asm_Operand const& dst, Asm_Operand const& src) {
+		if (IsAsmSegment(dst) || IsAsmSegment(src)) {
+			Asm_Operand const& segment = IsAsmSegment(dst) ? dst : src;
+			Asm_Operand const& other = IsAsmSegment(dst) ? src : dst;
+			if (!IsAsmRegMem(other) || IsAsmSegment(other) || other.size == Instruction_Operand_Prefix::Byte) {
+				return fail("Invalid combination of operands.");
+			}
+			emit08(IsAsmSegment(dst) ? 0b10001110 : 0b10001100);
+			emitModRM(other, getRegisterEncoding(segment.reg));
+			return true;
+		}
+
+		bool wide = false;
+		if (!getWidth(dst, src, wide)) return false;
+		if (IsAsmRegMem(dst) && IsAsmReg(src) && !(IsAsmDirectAddress(dst) && IsAsmAccumulator(src))) {
+			emit08(0b10001000 | wide);
+			emitModRM(dst, getRegisterEncoding(src.reg));
+		} else if (IsAsmReg(dst) && IsAsmMem(src) && !(IsAsmAccumulator(dst) && IsAsmDirectAddress(src))) {
+			emit08(0b10001010 | wide);
+			emitModRM(src, getRegisterEncoding(dst.reg));
+		} else if (IsAsmAccumulator(dst) && IsAsmDirectAddress(src)) {
+			emit08(0b10100000 | wide);
+			emit16(src.value);
+		} else if (IsAsmDirectAddress(dst) && IsAsmAccumulator(src)) {
+			emit08(0b10100010 | wide);
+			emit16(dst.value);
+		} else if (IsAsmReg(dst) && IsAsmImm(src)) {
+			emit08(0b10110000 | wide << 3 | getRegisterEncoding(dst.reg));
+			emitImmediate(src, wide);
+		} else if (IsAsmMem(dst) && IsAsmImm(src)) {
+			emit08(0b11000110 | wide);
+			emitModRM(dst, 0b000);
+			emitImmediate(src, wide);
+		} else {
+			return fail("Invalid combination of operands.");
+		}
+		return true;
+	}
+
+	// add, or, and, sub, xor and cmp, which share their formats.
+	bool encodeArithmetic(Instruction_Type const type, Asm_Operand const& dst, Asm_Operand const& src) {
+		struct Arithmetic_Encoding { Instruction_Type type; u8 opcode; u8 REG; };
+		constexpr Arithmetic_Encoding encodings[] = {
+			{Inst_add, 0b00000000, 0b000}, {Inst_or,  0b00001000, 0b001},
+			{Inst_and, 0b00100000, 0b100}, {Inst_sub, 0b00101000, 0b101},
+			{Inst_xor, 0b00110000, 0b110}, {Inst_cmp, 0b00111000, 0b111},
+		};
+		Arithmetic_Encoding const* encoding = nullptr;
+		for (auto const& it: encodings) {
+			if (it.type == type) encoding = &it;
+		}
+		assertTrue(encoding != nullptr);
+
+		if (IsAsmSegment(dst) || IsAsmSegment(src)) return fail("Invalid combination of operands.");
+		bool wide = false;
+		if (!getWidth(dst, src, wide)) return false;
+		if (IsAsmRegMem(dst) && IsAsmReg(src)) {
+			emit08(encoding->opcode | wide);
+			emitModRM(dst, getRegisterEncoding(src.reg));
+		} else if (IsAsmReg(dst) && IsAsmMem(src)) {
+			emit08(encoding->opcode | 0b10 | wide);
+			emitModRM(src, getRegisterEncoding(dst.reg));
+		} else if (IsAsmRegMem(dst) && IsAsmImm(src)) {
+			// Like nasm, a sign extended byte wins over the accumulator form when both are 3 bytes.
+			if (wide && src.known && fitsSignedByte(src.value)) {
+				emit08(0b10000011);
+				emitModRM(dst, encoding->REG);
+				emitImmediate(src, true, true);
+			} else if (IsAsmAccumulator(dst)) {
+				emit08(encoding->opcode | 0b100 | wide);
+				emitImmediate(src, wide);
+			} else {
+				emit08(0b10000000 | wide);
+				emitModRM(dst, encoding->REG);
+				emitImmediate(src, wide);
+			}
+		} else {
+			return fail("Invalid combination of operands.");
+		}
+		return true;
+	}
+
+	bool encodeTest(Asm_Operand const& dst, Asm_Operand const& src) {
+		if (IsAsmSegment(dst) || IsAsmSegment(src)) return fail("Invalid combination of operands.");
+		bool wide = false;
+		if (!getWidth(dst, src, wide)) return false;
+		if (IsAsmRegMem(dst) && IsAsmReg(src)) {
+			emit08(0b10000100 | wide);
+			emitModRM(dst, getRegisterEncoding(src.reg));
+		} else if (IsAsmReg(dst) && IsAsmMem(src)) {
+			emit08(0b10000100 | wide);
+			emitModRM(src, getRegisterEncoding(dst.reg));
+		} else if (IsAsmAccumulator(dst) && IsAsmImm(src)) {
+			emit08(0b10101000 | wide);
+			emitImmediate(src, wide);
+		} else if (IsAsmRegMem(dst) && IsAsmImm(src)) {
+			emit08(0b11110110 | wide);
+			emitModRM(dst, 0b000);
+			emitImmediate(src, wide);
+		} else {
+			return fail("Invalid combination of operands.");
+		}
+		return true;
+	}
+
+	bool encodeLea(Asm_Operand const& dst, Asm_Operand const& src) {
+		if (!IsAsmReg(dst) || IsAsmSegment(dst) || dst.reg.usage != RegisterUsage::x || !IsAsmMem(src)) {
+			return fail("lea expects a 16-bit register and an effective address.");
+		}
+		emit08(0b10001101);
+		emitModRM(src, getRegisterEncoding(dst.reg));
+		return true;
+	}
+
+	// mul, imul, div, idiv and not.
+	bool encodeUnary(Instruction_Type const type, Asm_Operand const& operand) {
+		u8 REG;
+		switch (type) {
+			case Inst_not:  REG = 0b010; break;
+			case Inst_mul:  REG = 0b100; break;
+			case Inst_imul: REG = 0b101; break;
+			case Inst_div:  REG = 0b110; break;
+			case Inst_idiv: REG = 0b111; break;
+			default: unreachable();
+		}
+		if (!IsAsmRegMem(operand) || IsAsmSegment(operand)) return fail("Invalid combination of operands.");
+		bool wide = false;
+		if (!getWidth(operand, Asm_Operand{}, wide)) return false;
+		emit08(0b11110110 | wide);
+		emitModRM(operand, REG);
+		return true;
+	}
+
+	bool encodeShift(Instruction_Type const type, Asm_Operand const& dst, Asm_Operand const& src) {
+		u8 REG;
+		switch (type) {
+			case Inst_shl: REG = 0b100; break;
+			case Inst_shr: REG = 0b101; break;
+			case Inst_sar: REG = 0b111; break;
+			default: unreachable();
+		}
+		if (!IsAsmRegMem(dst) || IsAsmSegment(dst)) return fail("Invalid combination of operands.");
+		bool wide = false;
+		if (!getWidth(dst, Asm_Operand{}, wide)) return false;
+
+		bool V;
+		if (IsAsmReg(src) && src.reg.type == Register::c && src.reg.usage == RegisterUsage::l) {
+			V = true;
+		} else if (IsAsmImm(src) && src.size == Instruction_Operand_Prefix::None) {
+			if (src.known && src.value != 1) return fail("The 8086 can only shift by 1 or by cl.");
+			V = false;
+		} else {
+			return fail("The 8086 can only shift by 1 or by cl.");
+		}
+		emit08(0b11010000 | V << 1 | wide);
+		emitModRM(dst, REG);
+		return true;
+	}
+
+	bool encodeJump(Instruction_Type const type, Asm_Operand const& target) {
+		if (!IsAsmImm(target) || target.size != Instruction_Operand_Prefix::None) {
+			return fail("Jumps only take a label or an address.");
+		}
+		u32 opcode = 0;
+		while (opcode < 256 && jumpTypeFromByte(opcode) != type) opcode++;
+		assertTrue(opcode < 256);
+
+		i64 const offset = target.value - (here + 2);
+		if (target.known && (offset < -128 || offset > 127)) {
+			failLater("The jump is out of range by %lld bytes, the 8086 can only jump -128 to 127 bytes here.",
+				cast(long long)(offset < 0 ? -128 - offset : offset - 127));
+		}
+		emit08(opcode);
+		emit08(offset);
+		return true;
+	}
+
+	bool assembleLine(String_View const& text) {
+		Asm_Lexer lexer(text);
+		Token token = lexer.next();
+		if (token.kind == Token_Kind::Identifier && lexer.nextIsSymbol(':')) {
+			lexer.next();
+			if (!defineLabel(token.text)) return false;
+			token = lexer.next();
+		}
+		if (token.kind == Token_Kind::End) return true;
+		if (token.kind != Token_Kind::Identifier) {
+			return fail("Expected an instruction, got '%.*s'.", cast(int)token.text.count, token.text.items);
+		}
+
+		Instruction_Type const type = lookupMnemonic(token.text);
+		if (type == Inst_None) {
+			return fail("The instruction '%.*s' is not supported.", cast(int)token.text.count, token.text.items);
+		}
+
+		Asm_Operand operands[2] = {};
+		u8 operandCount = 0;
+		if (lexer.peek().kind != Token_Kind::End) {
+			for (;;) {
+				if (operandCount == StaticArrayCount(operands)) return fail("Too many operands.");
+				if (!parseOperand(lexer, operands[operandCount++])) return false;
+				Token const after = lexer.next();
+				if (after.kind == Token_Kind::End) break;
+				if (after.kind != Token_Kind::Symbol || after.symbol != ',') {
+					return fail("Expected ',' or the end of the line, got '%.*s'.", cast(int)after.text.count, after.text.items);
+				}
+			}
+		}
+
+		u8 expectedCount;
+		switch (type) {
+			case Inst_bits: case Inst_mul: case Inst_imul: case Inst_div: case Inst_idiv: case Inst_not:
+				expectedCount = 1;
+				break;
+			default:
+				expectedCount = (IsInstJump(type)) ? 1 : 2;
+				break;
+		}
+		if (operandCount != expectedCount) {
+			return fail("'%s' expects %u operand%s.", Instruction_Mnemonics[type], expectedCount, expectedCount == 1 ? "" : "s");
+		}
+
+		Asm_Operand const& dst = operands[0];
+		Asm_Operand const& src = operands[1];
+		switch (type) {
+			case Inst_bits:
+				if (!IsAsmImm(dst) || !dst.known || dst.value != 16) return fail("Only 'bits 16' is supported.");
+				return true;
+			case Inst_mov:
+				return encodeMov(dst, src);
+			case Inst_add: case Inst_or: case Inst_and: case Inst_sub: case Inst_xor: case Inst_cmp:
+				return encodeArithmetic(type, dst, src);
+			case Inst_test:
+				return encodeTest(dst, src);
+			case Inst_lea:
+				return encodeLea(dst, src);
+			case Inst_mul: case Inst_imul: case Inst_div: case Inst_idiv: case Inst_not:
+				return encodeUnary(type, dst);
+			case Inst_shl: case Inst_shr: case Inst_sar:
+				return encodeShift(type, dst, src);
+			default:
+				assertTrue(IsInstJump(type));
+				return encodeJump(type, dst);
+		}
+	}
+
+	bool assemblePass(String_View const& source) {
+		bytes.clear();
+		scope.clear();
+		labelsChanged = false;
+		hasDeferredError = false;
+		line = 0;
+
+		const char* at = source.items;
+		const char* const end = source.items + source.count;
+		while (at < end) {
+			const char* lineEnd = at;
+			while (lineEnd < end && *lineEnd != '\n') lineEnd++;
+			const char* codeEnd = at;
+			while (codeEnd < lineEnd && *codeEnd != ';') codeEnd++;
+
+			line++;
+			here = cast(i64)bytes.size();
+			if (!assembleLine(String_View(at, codeEnd - at))) return false;
+			at = lineEnd + 1;
+		}
+		return true;
+	}
+};
+
+bool assemble(String_View const source, Slice<u8>& outBinary, Assembler_Error& outError) {
+	Assembler assembler;
+	for (assembler.pass = 1; assembler.pass <= ASSEMBLER_MAX_PASSES; assembler.pass++) {
+		if (!assembler.assemblePass(source)) {
+			outError = assembler.error;
+			return false;
+		}
+		if (!assembler.labelsChanged) break;
+	}
+	if (assembler.labelsChanged) {
+		outError = {.line = 0};
+		snprintf(outError.message, sizeof(outError.message), "The labels kept moving after %d passes.", ASSEMBLER_MAX_PASSES);
+		return false;
+	}
+	if (assembler.hasDeferredError) {
+		outError = assembler.deferredError;
+		return false;
+	}
+
+	std::vector<u8> const& bytes = assembler.bytes;
+	u8* buffer = bytes.empty() ? nullptr : static_cast<u8*>(malloc(bytes.size()));
+	if (!bytes.empty()) {
+		assertTrue(buffer != nullptr);
+		memcpy(buffer, bytes.data(), bytes.size());
+	}
+	outBinary = PtrToSlice(buffer, bytes.size());
+	return true;
+}
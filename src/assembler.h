@@ -0,0 +1,25 @@
+#pragma once
+
+#include "decoder.h"
+
+// Turns 8086 assembly into machine code in memory, so running a listing
+// doesn't need nasm. It knows the mnemonics in instructions.inl (and the
+// other nasm spellings of them, like jnz or sal) and picks the encodings nasm
+// picks, so a listing assembles to the same bytes it always did.
+//
+// Besides instructions it understands `bits 16`, labels (including nasm's
+// local ones like `.LBB1_4:`), byte/word prefixes, effective addresses like
+// [bp + di - 4*8] and constant expressions with + - * / %, parentheses,
+// labels, `$` and `$$`.
+
+// Goes up whenever the same source could assemble into different bytes, so
+// binaries cached by an older assembler stop being used.
+#define ASSEMBLER_VERSION 1
+
+struct Assembler_Error {
+	u32 line;  // Starting at 1.
+	char message[160];
+};
+
+// On success outBinary holds memory from malloc() that the caller frees.
+bool assemble(String_View source, Slice<u8>& outBinary, Assembler_Error& outError);
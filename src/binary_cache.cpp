@@ -0,0 +1,97 @@
+#include "binary_cache.h"
+
+#include <filesystem>
+#include <string>
+#include <thread>
+
+#include "assembler.h"
+
+#define BINARY_CACHE_MAGIC 0x36384D53 // "SM86"
+
+// Written before the bytes, to tell a hash collision or a broken file from a hit.
+struct Binary_Cache_Header {
+	u32 magic;
+	u32 assemblerVersion;
+	u64 sourceHash;
+	u64 sourceSize;
+	u64 binarySize;
+};
+
+// FNV-1a, over ASSEMBLER_VERSION and then the source.
+static u64 hashSource(Slice<u8> const& source) {
+	u64 hash = 0xCBF29CE484222325;
+	u32 const version = ASSEMBLER_VERSION;
+	for (size_t i = 0; i < sizeof(version); i++) {
+		hash = (hash ^ ((version >> (8 * i)) & 0xFF)) * 0x100000001B3;
+	}
+	for (size_t i = 0; i < source.count; i++) {
+		hash = (hash ^ source.ptr[i]) * 0x100000001B3;
+	}
+	return hash;
+}
+
+static std::string getCachePath(u64 const hash) {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", cast(unsigned long long)hash);
+	return (std::filesystem::path(BINARY_CACHE_FOLDER) / name).string();
+}
+
+bool loadCachedBinary(Slice<u8> const& source, Slice<u8>& outBinary) {
+	u64 const hash = hashSource(source);
+	FILE* file = fopen(getCachePath(hash).c_str(), "rb");
+	if (file == nullptr) return false;
+	defer(fclose(file));
+
+	Binary_Cache_Header header;
+	if (fread(&header, sizeof(header), 1, file) != 1) return false;
+	if (header.magic != BINARY_CACHE_MAGIC || header.assemblerVersion != ASSEMBLER_VERSION ||
+	    header.sourceHash != hash || header.sourceSize != source.count) {
+		return false;
+	}
+
+	u8* buffer = header.binarySize ? static_cast<u8*>(malloc(header.binarySize)) : nullptr;
+	if (header.binarySize) {
+		assertTrue(buffer != nullptr);
+		if (fread(buffer, header.binarySize, 1, file) != 1) {
+			free(buffer);
+			return false;
+		}
+	}
+	outBinary = PtrToSlice(buffer, header.binarySize);
+	return true;
+}
+
+void storeCachedBinary(Slice<u8> const& source, Slice<u8> const& binary) {
+	namespace fs = std::filesystem;
+	std::error_code error;
+	fs::create_directories(BINARY_CACHE_FOLDER, error);
+	if (error) return;
+
+	// Written to a name only this thread uses and renamed into place, so a
+	// reader never sees half a file.
+	u64 const hash = hashSource(source);
+	std::string const path = getCachePath(hash);
+	std::string const tempPath = path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file == nullptr) return;
+
+	Binary_Cache_Header const header = {
+		.magic = BINARY_CACHE_MAGIC,
+		.assemblerVersion = ASSEMBLER_VERSION,
+		.sourceHash = hash,
+		.sourceSize = source.count,
+		.binarySize = binary.count,
+	};
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (binary.count > 0) {
+		ok = ok && fwrite(binary.ptr, binary.count, 1, file) == 1;
+	}
+	ok = (fclose(file) == 0) && ok;
+
+	if (ok) {
+		fs::rename(tempPath, path, error);
+	}
+	if (!ok || error) {
+		fs::remove(tempPath, error);
+	}
+}
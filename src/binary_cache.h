@@ -0,0 +1,15 @@
+#pragma once
+
+#include "util.h"
+
+// Assembled binaries kept on disk so an unchanged listing doesn't get
+// assembled again. Each one is a file in BINARY_CACHE_FOLDER named after a
+// hash of the source and ASSEMBLER_VERSION, so an edited listing or a newer
+// assembler just misses, nothing ever has to be invalidated.
+
+#define BINARY_CACHE_FOLDER ".sim86-cache"
+
+// On a hit outBinary holds memory from malloc() that the caller frees.
+bool loadCachedBinary(Slice<u8> const& source, Slice<u8>& outBinary);
+// Safe to call from several threads, even for the same source.
+void storeCachedBinary(Slice<u8> const& source, Slice<u8> const& binary);
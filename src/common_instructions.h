@@ -1,6 +1,164 @@
 #pragma once
 
 #include "decoder.h"
+#include "opcode_table.h"
 
-bool isByte_common_inst(Decoder_Context &decoder, u8 &byte);
-void decode_common_inst(Decoder_Context &decoder, u8 &byte);
+struct Three_Variants {
+	u8 firstByteLiteral[3];
+	u8 format1Literal  : 3;
+	bool has_S_on_fmt1 : 1;
+};
+
+struct One_Variant {
+	u8 literal             : 8;
+	u8 literal3bit         : 3;
+	u8 shift               : 2;
+	bool hasOnlyOneOperand : 1;
+};
+
+struct Common_Format {
+	Instruction_Type type;
+	union {
+		One_Variant one;
+		Three_Variants three;
+	};
+	bool hasOnlyOneVariant;
+};
+
+constexpr Common_Format formatList[] = {
+	{
+		.type = Inst_add,
+		.three = {
+			.firstByteLiteral = {[0]=0b000000, [1]=0b100000, [2]=0b0000010},
+			.format1Literal = 0b000,
+			.has_S_on_fmt1 = true,
+		},
+	},
+	{
+		.type = Inst_sub,
+		.three = {
+			.firstByteLiteral = {[0]=0b001010, [1]=0b100000, [2]=0b0010110},
+			.format1Literal = 0b101,
+			.has_S_on_fmt1 = true,
+		},
+	},
+	{
+		.type = Inst_cmp,
+		.three = {
+			.firstByteLiteral = {[0]=0b001110, [1]=0b100000, [2]=0b0011110},
+			.format1Literal = 0b111,
+			.has_S_on_fmt1 = true,
+		},
+	},
+	{
+		.type = Inst_lea,
+		.one = { .literal = 0b10001101, .shift = 0},
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_mul,
+		.one = { .literal = 0b1111011, .literal3bit = 0b100, .shift = 1, .hasOnlyOneOperand = true  },
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_imul,
+		.one = { .literal = 0b1111011, .literal3bit = 0b101, .shift = 1, .hasOnlyOneOperand = true  },
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_div,
+		.one = { .literal = 0b1111011, .literal3bit = 0b110, .shift = 1, .hasOnlyOneOperand = true  },
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_div,
+		.one = { .literal = 0b1111011, .literal3bit = 0b110, .shift = 1, .hasOnlyOneOperand = true  },
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_idiv,
+		.one = { .literal = 0b1111011, .literal3bit = 0b111, .shift = 1, .hasOnlyOneOperand = true  },
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_shl,
+		.one = { .literal = 0b110100, .literal3bit = 0b100, .shift = 2 },
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_shr,
+		.one = { .literal = 0b110100, .literal3bit = 0b101, .shift = 2 },
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_sar,
+		.one = { .literal = 0b110100, .literal3bit = 0b111, .shift = 2 },
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_not,
+		.one = { .literal = 0b1111011, .literal3bit = 0b010, .shift = 1, .hasOnlyOneOperand = true  },
+		.hasOnlyOneVariant = true,
+	},
+	{
+		.type = Inst_and,
+		.three = {
+			.firstByteLiteral = {[0]=0b001000, [1]=0b1000000, [2]=0b0010010},
+			.format1Literal = 0b100,
+			.has_S_on_fmt1 = false,
+		},
+	},
+	{
+		.type = Inst_test,
+		.three = {
+			.firstByteLiteral = {[0]=0b000100, [1]=0b1111011, [2]=0b1010100},
+			.format1Literal = 0b000,
+			.has_S_on_fmt1 = false,
+		},
+	},
+	{
+		.type = Inst_or,
+		.three = {
+			.firstByteLiteral = {[0]=0b000010, [1]=0b1000000, [2]=0b0000110},
+			.format1Literal = 0b001,
+			.has_S_on_fmt1 = false,
+		},
+	},
+	{
+		.type = Inst_xor,
+		.three = {
+			.firstByteLiteral = {[0]=0b001100, [1]=0b0011010, [2]=0b0011010},
+			.format1Literal = 0b110,
+			.has_S_on_fmt1 = false,
+		},
+	},
+};
+
+// Returns which of the formats matched (0, 1 or 2), 0 for formats with only
+// one variant, or -1 when the byte doesn't belong to the format.
+// REG is the REG field of the byte that follows, only looked at by the
+// formats whose opcode extends into the ModRM byte.
+constexpr i8 matchCommonFormat(Common_Format const& format, u8 const byte, u8 const REG) {
+	if (format.hasOnlyOneVariant) {
+		if (format.one.shift == 0) {
+			return (format.one.literal == byte) ? 0 : -1;
+		}
+		if ((byte >> format.one.shift) != format.one.literal) return -1;
+		return (REG == format.one.literal3bit) ? 0 : -1;
+	}
+
+	auto const byte1lit = format.three.firstByteLiteral;
+	u8 const fmt1_shift = format.three.has_S_on_fmt1 ? 2 : 1;
+
+	if ((byte >> 2) == byte1lit[0]) {
+		return 0;
+	} else if ((byte >> fmt1_shift) == byte1lit[1]) {
+		if (REG == format.three.format1Literal) return 1;
+	} else if ((byte >> 1) == byte1lit[2]) {
+		return 2;
+	}
+	return -1;
+}
+
+Decoded_Instruction decode_common_inst(Decoder_Context &decoder, u8 &byte, Opcode_Entry const& entry);
+void exec_common_inst(Machine& machine, Decoder_Context &decoder, Instruction const& inst, Exec_Trace& trace);
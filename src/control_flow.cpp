@@ -0,0 +1,114 @@
+#include "control_flow.h"
+
+#include <algorithm>
+
+#include "formatter.h"
+
+// The instruction that starts at offset, -1 if none does.
+static i64 findInstruction(Instruction_Stream const& stream, i64 const offset) {
+	auto const it = std::lower_bound(stream.items.begin(), stream.items.end(), offset,
+		[](Packed_Decoded_Instruction const& decoded, i64 const at) { return decoded.offset < at; });
+	if (it == stream.items.end() || it->offset != offset) return -1;
+	return it - stream.items.begin();
+}
+
+i32 Control_Flow_Graph::findBlock(u32 const offset) const {
+	auto const it = std::lower_bound(blocks.begin(), blocks.end(), offset,
+		[](Basic_Block const& block, u32 const at) { return block.start < at; });
+	if (it == blocks.end() || it->start != offset) return BLOCK_NONE;
+	return cast(i32)(it - blocks.begin());
+}
+
+void buildControlFlowGraph(Instruction_Stream const& stream, Control_Flow_Graph& cfg) {
+	size_t const count = stream.items.size();
+	cfg.blocks.clear();
+	if (count == 0) return;
+
+	// A block starts at the program's entry, at every jump target and after every jump.
+	std::vector<bool> isLeader(count, false);
+	isLeader[0] = true;
+	for (size_t i = 0; i < count; i++) {
+		Packed_Decoded_Instruction const& decoded = stream.items[i];
+		if (!IsInstJump(decoded.inst.type())) continue;
+		if (i64 const target = findInstruction(stream, getJumpTarget(decoded)); target != -1) {
+			isLeader[target] = true;
+		}
+		if (i + 1 < count) {
+			isLeader[i + 1] = true;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (isLeader[i]) {
+			cfg.blocks.push_back(Basic_Block{.start = stream.items[i].offset, .first = cast(u32)i});
+		}
+		Basic_Block& block = cfg.blocks.back();
+		block.count++;
+		block.end = stream.items[i].offset + stream.items[i].size;
+	}
+
+	for (size_t b = 0; b < cfg.blocks.size(); b++) {
+		Basic_Block& block = cfg.blocks[b];
+		Packed_Decoded_Instruction const& last = stream.items[block.first + block.count - 1];
+		block.endsInJump = IsInstJump(last.inst.type());
+		if (block.endsInJump) {
+			i64 const target = getJumpTarget(last);
+			block.taken = (target >= 0 && target <= UINT32_MAX) ? cfg.findBlock(cast(u32)target) : BLOCK_NONE;
+			block.leavesProgram |= block.taken == BLOCK_NONE;
+		}
+		if (b + 1 < cfg.blocks.size() && cfg.blocks[b + 1].start == block.end) {
+			block.next = cast(i32)(b + 1);
+		} else {
+			block.leavesProgram = true;
+		}
+	}
+
+	for (size_t b = 0; b < cfg.blocks.size(); b++) {
+		Basic_Block const& block = cfg.blocks[b];
+		if (block.taken != BLOCK_NONE) {
+			cfg.blocks[block.taken].predecessors.push_back(b);
+		}
+		if (block.next != BLOCK_NONE && block.next != block.taken) {
+			cfg.blocks[block.next].predecessors.push_back(b);
+		}
+	}
+}
+
+void printControlFlowGraphDot(FILE* const outFile, Instruction_Stream const& stream, Control_Flow_Graph const& cfg) {
+	Formatter formatter(outFile, false, false);
+	fprintfln(outFile, "digraph cfg {");
+	fprintfln(outFile, "\tnode [shape=box, fontname=\"monospace\"];");
+
+	bool anyLeaves = false;
+	for (size_t b = 0; b < cfg.blocks.size(); b++) {
+		Basic_Block const& block = cfg.blocks[b];
+		fprintf(outFile, "\tb%zu [label=\"block %zu (0x%04X)\\l", b, b, block.start);
+		for (u32 i = block.first; i < block.first + block.count; i++) {
+			formatter.printInstText(stream.items[i].inst.unpack());
+			fprintf(outFile, "\\l");
+		}
+		fprintfln(outFile, "\"];");
+		anyLeaves |= block.leavesProgram;
+	}
+	if (anyLeaves) {
+		fprintfln(outFile, "\texit [shape=oval];");
+	}
+
+	for (size_t b = 0; b < cfg.blocks.size(); b++) {
+		Basic_Block const& block = cfg.blocks[b];
+		if (block.endsInJump) {
+			if (block.taken != BLOCK_NONE) {
+				fprintfln(outFile, "\tb%zu -> b%d [label=\"taken\"];", b, block.taken);
+			} else {
+				fprintfln(outFile, "\tb%zu -> exit [label=\"taken\"];", b);
+			}
+		}
+		const char* const label = block.endsInJump ? " [label=\"not taken\"]" : "";
+		if (block.next != BLOCK_NONE) {
+			fprintfln(outFile, "\tb%zu -> b%d%s;", b, block.next, label);
+		} else {
+			fprintfln(outFile, "\tb%zu -> exit%s;", b, label);
+		}
+	}
+	fprintfln(outFile, "}");
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "instruction_stream.h"
+
+// The decoded program split into basic blocks, runs of instructions that
+// always execute together: only the first one of a block can be jumped to
+// and only the last one can jump. Every jump is conditional on the 8086
+// instructions the decoder knows, so a block ends in at most two edges.
+
+#define BLOCK_NONE -1
+
+struct Basic_Block {
+	u32 start, end;             // Byte offsets into the binary, end excluded.
+	u32 first, count;           // Where its instructions are in Instruction_Stream::items.
+	i32 taken = BLOCK_NONE;     // Where the jump at the end goes when it's taken.
+	i32 next = BLOCK_NONE;      // The block it falls through into.
+	bool endsInJump = false;
+	bool leavesProgram = false; // Some way out of it doesn't reach a block, like falling off the end.
+	std::vector<u32> predecessors;
+};
+
+struct Control_Flow_Graph {
+	std::vector<Basic_Block> blocks;
+
+	// The block that starts at offset, BLOCK_NONE if none does.
+	[[nodiscard]] i32 findBlock(u32 offset) const;
+};
+
+// Where a jump goes, relative to the start of the binary.
+force_inline inline i64 getJumpTarget(Packed_Decoded_Instruction const& decoded) {
+	return cast(i64)decoded.offset + decoded.size + decoded.inst.dst().jump_offset;
+}
+
+void buildControlFlowGraph(Instruction_Stream const& stream, Control_Flow_Graph& cfg);
+// Graphviz, one node per block listing its instructions.
+void printControlFlowGraphDot(FILE* outFile, Instruction_Stream const& stream, Control_Flow_Graph const& cfg);
@@ -0,0 +1,59 @@
+#include "decode_stream.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <memory>
+
+#include "opcode_table.h"
+#include "instruction_stream.h"
+#include "formatter.h"
+
+void Decode_Stream::refill(size_t const consumed) {
+	assertTrue(consumed <= window.count);
+	size_t const left = window.count - consumed;
+	memmove(buffer, window.ptr + consumed, left);
+	windowOffset += consumed;
+	window = Slice<u8>(buffer, left);
+
+	while (!ended && window.count < StaticArrayCount(buffer)) {
+		size_t const n = fread(buffer + window.count, 1, StaticArrayCount(buffer) - window.count, file);
+		window.count += n;
+		if (n == 0) {
+			ended = true;
+			failed = ferror(file);
+		}
+	}
+}
+
+bool decodeStream(FILE* const inFile, FILE* const outFile, bool const showClocks) {
+	Formatter formatter(outFile, showClocks);
+	formatter.printBitsHeader();
+
+	std::unique_ptr<Decode_Stream> const stream = std::make_unique<Decode_Stream>(inFile);
+	Decoder_Context decoder(stream->window);
+	for (;;) {
+		// Only refilled between instructions, so the window never moves under one.
+		if (stream->window.count - decoder.bytesRead < MAX_BYTES_PER_INSTRUCTION_8086 && !stream->ended) {
+			stream->refill(decoder.bytesRead);
+			decoder.bytesRead = 0;
+		}
+		if (decoder.bytesRead >= stream->window.count) break;
+
+		Decoded_Instruction decoded;
+		u8 const* const bytes = stream->window.ptr + decoder.bytesRead;
+		if (decodeNext(decoder, decoded) == nullptr) {
+			formatter.printUnrecognizedByte(*bytes);
+			return false;
+		}
+		formatter.printDecoded(decoded, bytes);
+		decoder.resetByteStack();
+	}
+
+	if (stream->failed) {
+		eprintfln(LOG_ERROR_STRING": Could not read the input after byte %" PRIu64 ": %s",
+			stream->windowOffset + stream->window.count, strerror(errno));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "decoder.h"
+
+// Disassembles a file without ever having all of it in memory, so a dump of
+// any size decodes in the same few kilobytes. The file is read a chunk at a
+// time into a window that always holds at least MAX_BYTES_PER_INSTRUCTION_8086
+// bytes ahead of the decoder (until the file ends), and what's left of the
+// window is moved to the front before the next chunk goes in behind it, so an
+// instruction split between two chunks decodes as if it never was.
+
+#define DECODE_STREAM_CHUNK_SIZE (64 * 1024)
+
+struct Decode_Stream {
+	FILE* const file;
+	Slice<u8> window;      // The bytes of the file in buffer that haven't been dropped yet.
+	u64 windowOffset = 0;  // Where window.ptr[0] is in the file.
+	bool ended = false;
+	bool failed = false;   // Reading went wrong, errno says why.
+	u8 buffer[DECODE_STREAM_CHUNK_SIZE + MAX_BYTES_PER_INSTRUCTION_8086];
+
+	explicit Decode_Stream(FILE* const File): file(File), window(buffer, 0) {}
+
+	// Drops the first `consumed` bytes of the window and reads behind what's left.
+	void refill(size_t consumed);
+};
+
+// Prints the same thing decodeOrSimulate() does when it only decodes.
+bool decodeStream(FILE* inFile, FILE* outFile, bool showClocks);
@@ -2,17 +2,25 @@
 #include <cstdio>
 #include <cstring>
 #include <cmath>
+#include <memory>
 
 #include "decoder.h"
 #include "mov.h"
 #include "common_instructions.h"
 #include "jumps.h"
+#include "opcode_table.h"
+#include "instruction_cache.h"
+#include "instruction_stream.h"
+#include "instruction_lengths.h"
+#include "parallel_sweep.h"
+#include "formatter.h"
+#include "interpreter.h"
+#include "control_flow.h"
+#include "flag_liveness.h"
+#include "jit.h"
 #include "util.h"
 #include "string_builder.h"
 
-u16 gRegisterValues[RegisterCount] = {0};
-u8 gMemory[1024 * 1024] = {0};
-u64 gClocks = 0;
 
 Disp_Type get_Disp_Type(u8 const MOD, u8 const R_M) {
 	switch (MOD) {
@@ -40,7 +48,7 @@ Instruction_Operand_Prefix getInstDstPrefix(Instruction const& inst) {
 	return Instruction_Operand_Prefix::None;
 }
 
-String_Builder getInstOpName(Instruction_Operand const& operand) {
+String_Builder getInstOpName(Machine const& machine, Instruction_Operand const& operand) {
 	String_Builder builder = string_builder_make();
 
 	switch (operand.type) {
@@ -50,7 +58,7 @@ String_Builder getInstOpName(Instruction_Operand const& operand) {
 
 		case Instruction_Operand_Type::EffectiveAddress: {
 			builder.append('[');
-			builder.append(EffectiveAddress::getInnerValue(operand.address));
+			builder.append(EffectiveAddress::getInnerValue(machine, operand.address));
 			builder.append(']');
 		} break;
 
@@ -67,46 +75,49 @@ String_Builder getInstOpName(Instruction_Operand const& operand) {
 	return builder;
 }
 
-u32 getInstOpValue(Instruction_Operand const& operand) {
+u32 getInstOpValue(Machine const& machine, Instruction_Operand const& operand) {
 	switch (operand.type) {
-		case Instruction_Operand_Type::Register:     return getRegisterValue(operand.reg);
-		case Instruction_Operand_Type::RegisterPair: return getRegisterValue(operand.reg_pair.b);
-		case Instruction_Operand_Type::Immediate:    return operand.immediate.word;
+		case Instruction_Operand_Type::Register:     return getRegisterValue(machine, operand.reg);
+		case Instruction_Operand_Type::RegisterPair: return getRegisterValue(machine, operand.reg_pair.b);
+		case Instruction_Operand_Type::Immediate: {
+			// Byte immediates of 16-bit instructions (S = 1) are sign extended.
+			return operand.immediate.wide ? operand.immediate.word : operand.immediate.byte;
+		}
 
 		case Instruction_Operand_Type::EffectiveAddress: {
-			u32 const idx = EffectiveAddress::getInnerValue(operand.address);
-			StaticArrayBoundsCheck(idx, gMemory);
+			u32 const idx = EffectiveAddress::getInnerValue(machine, operand.address);
+			StaticArrayBoundsCheck(idx, machine.memory);
 			if (operand.address.wide) {
-				StaticArrayBoundsCheck(idx+1, gMemory);
-				return (gMemory[idx+1] << 8) + gMemory[idx+0];
+				StaticArrayBoundsCheck(idx+1, machine.memory);
+				return (machine.memory[idx+1] << 8) + machine.memory[idx+0];
 			} else {
-				return gMemory[idx];
+				return machine.memory[idx];
 			}
 		}
 		default: return 0;
 	}
 }
 
-void setInstOpValue(Instruction_Operand const& operand, u32 const value) {
+void setInstOpValue(Machine& machine, Instruction_Operand const& operand, u32 const value) {
 	switch (operand.type) {
 		case Instruction_Operand_Type::Register: {
-			setRegisterValue(operand.reg, value);
+			setRegisterValue(machine, operand.reg, value);
 		} break;
 
 		case Instruction_Operand_Type::RegisterPair: {
-			setRegisterValue(operand.reg_pair.b, value & 0xFFFF);
-			setRegisterValue(operand.reg_pair.a, value >> 16);
+			setRegisterValue(machine, operand.reg_pair.b, value & 0xFFFF);
+			setRegisterValue(machine, operand.reg_pair.a, value >> 16);
 		} break;
 
 		case Instruction_Operand_Type::EffectiveAddress: {
-			u32 const idx = EffectiveAddress::getInnerValue(operand.address);
-			StaticArrayBoundsCheck(idx, gMemory);
+			u32 const idx = EffectiveAddress::getInnerValue(machine, operand.address);
+			StaticArrayBoundsCheck(idx, machine.memory);
 			if (operand.address.wide) {
-				StaticArrayBoundsCheck(idx+1, gMemory);
-				gMemory[idx+0] = value & 0xFF;
-				gMemory[idx+1] = value >> 8;
+				StaticArrayBoundsCheck(idx+1, machine.memory);
+				machine.memory[idx+0] = value & 0xFF;
+				machine.memory[idx+1] = value >> 8;
 			} else {
-				gMemory[idx] = value;
+				machine.memory[idx] = value;
 			}
 		} break;
 
@@ -115,15 +126,6 @@ void setInstOpValue(Instruction_Operand const& operand, u32 const value) {
 }
 
 namespace FlagsRegister {
-	void setBit(Bit const& bit, bool const value) {
-		u16 const b = static_cast<u16>(bit);
-		if (value) {
-            gRegisterValues[RegToID(Register::fl)] |= (1 << b);
-		} else {
-            gRegisterValues[RegToID(Register::fl)] &= ~(1 << b);
-		}
-	}
-
 	void printSet(FILE* outFile, u16 const flags) {
 		for (Bit const bit: BitList) {
 			if (getBit(bit, flags)) {
@@ -132,23 +134,6 @@ namespace FlagsRegister {
 		}
 	}
 
-	void printSet(FILE* outFile) {
-		printSet(outFile, get());
-	}
-
-	u16 get() {
-		return gRegisterValues[RegToID(Register::fl)];
-	}
-
-	bool getBit(Bit const& bit, u16 const flags) {
-		u16 const b = static_cast<u16>(bit);
-		return (flags >> b) & 1;
-	}
-
-	bool getBit(Bit const& bit) {
-		return getBit(bit, get());
-	}
-
     char getLetter(Bit const& bit) {
         switch (bit) {
             case Bit::CF: return 'C'; case Bit::PF: return 'P'; case Bit::AF: return 'A';
@@ -174,29 +159,26 @@ namespace FlagsRegister {
     }
 }
 
-u16 getRegisterValue(RegisterInfo const& reg) {
-	u8 const idx = RegToID(reg.type);
-	switch (reg.usage) {
-	case RegisterUsage::x: return gRegisterValues[idx];
-	case RegisterUsage::h: return reinterpret_cast<u8*>(gRegisterValues + idx)[1];
-	case RegisterUsage::l: return reinterpret_cast<u8*>(gRegisterValues + idx)[0];
-	default: unreachable();
-	}
+// A byte register reads the word starting at it and masks the rest off, dh
+// being the last one that can, so neither direction needs to branch on the size.
+u16 getRegisterValue(Machine const& machine, RegisterInfo const& reg) {
+	u16 word;
+	memcpy(&word, machine.registers.bytes + getRegisterOffset(reg), sizeof(word));
+	return word & getRegisterMask(reg);
 }
 
-void setRegisterValue(RegisterInfo const& reg, u16 const value) {
-	u8 const idx = RegToID(reg.type);
-	switch (reg.usage) {
-	case RegisterUsage::x: gRegisterValues[idx] = value; break;
-	case RegisterUsage::h: reinterpret_cast<u8*>(gRegisterValues + idx)[1] = static_cast<u8>(value); break;
-	case RegisterUsage::l: reinterpret_cast<u8*>(gRegisterValues + idx)[0] = static_cast<u8>(value); break;
-	default: unreachable();
-	}
+void setRegisterValue(Machine& machine, RegisterInfo const& reg, u16 const value) {
+	u8* const at = machine.registers.bytes + getRegisterOffset(reg);
+	u16 const mask = getRegisterMask(reg);
+	u16 word;
+	memcpy(&word, at, sizeof(word));
+	word = (word & ~mask) | (value & mask);
+	memcpy(at, &word, sizeof(word));
 }
 
-void incrementRegister(RegisterInfo const& reg, i16 const increment) {
-	u16 const old = getRegisterValue(reg);
-	setRegisterValue(reg, old + increment);
+void incrementRegister(Machine& machine, RegisterInfo const& reg, i16 const increment) {
+	u16 const old = getRegisterValue(machine, reg);
+	setRegisterValue(machine, reg, old + increment);
 }
 
 const char* getRegisterName(RegisterInfo const& reg) {
@@ -236,26 +218,28 @@ namespace EffectiveAddress {
     	}
     }
 
-	u32 getInnerValue(Info const& info) {
-    	u32 result;
-    	switch (info.base) {
-			case Base::bx_si:  result = getRegisterValue(RegX(b))  + getRegisterValue(RegX(si)); break;
-			case Base::bx_di:  result = getRegisterValue(RegX(b))  + getRegisterValue(RegX(di)); break;
-			case Base::bp_si:  result = getRegisterValue(RegX(bp)) + getRegisterValue(RegX(si)); break;
-			case Base::bp_di:  result = getRegisterValue(RegX(bp)) + getRegisterValue(RegX(di)); break;
-			case Base::si:     result = getRegisterValue(RegX(si)); break;
-			case Base::di:     result = getRegisterValue(RegX(di)); break;
-			case Base::bp:     result = getRegisterValue(RegX(bp)); break;
-			case Base::bx:     result = getRegisterValue(RegX(b));  break;
-			case Base::Direct: result = 0;
-    	}
-    	if (info.displacement.wide) {
-    		result += info.displacement.word;
-    	} else {
-    		result += info.displacement.byte;
-    	}
-    	return result;
-    }
+	u32 getInnerValue(Machine const& machine, Info const& info) {
+		#define R(r) cast(u32)machine.registers.words[RegToID(Register::r)]
+		u32 result = 0;
+		switch (info.base) {
+			case Base::bx_si:  result = R(b)  + R(si); break;
+			case Base::bx_di:  result = R(b)  + R(di); break;
+			case Base::bp_si:  result = R(bp) + R(si); break;
+			case Base::bp_di:  result = R(bp) + R(di); break;
+			case Base::si:     result = R(si); break;
+			case Base::di:     result = R(di); break;
+			case Base::bp:     result = R(bp); break;
+			case Base::bx:     result = R(b);  break;
+			case Base::Direct: result = 0;     break;
+		}
+		#undef R
+		if (info.displacement.wide) {
+			result += info.displacement.word;
+		} else {
+			result += info.displacement.byte;
+		}
+		return result;
+	}
 
 	u8 getClocks(Info const& info) {
     	if (has_EA_Disp(info)) {
@@ -282,40 +266,55 @@ namespace EffectiveAddress {
     }
 }
 
-u8 getPartClocks(Clock_Calculation_Part const& part) {
+u8 getStaticPartClocks(Clock_Calculation_Part const& part) {
 	switch (part.type) {
 		case Clock_Inst:  return part.value;
 		case Clock_EA:    return EffectiveAddress::getClocks(part.address);
 		case Clock_Range: return part.B;
 		case Clock_AorB:  return Max(part.A, part.B);
 		case Clock_SegmentOverride: return 2;
-		case Clock_16bitTransfer:   return 4 * part.value;
 		default: return 0;
 	}
 }
 
-u16 getTotalClocks(Clock_Calculation const& calculation) {
+u8 getPartClocks(Machine const& machine, Clock_Calculation_Part const& part) {
+	if (part.type == Clock_16bitTransfer) {
+		bool const is_odd = EffectiveAddress::getInnerValue(machine, part.transfer.address) % 2 == 1;
+		return is_odd ? 4 * part.transfer.count : 0;
+	}
+	return getStaticPartClocks(part);
+}
+
+u16 getTotalClocks(Machine const& machine, Clock_Calculation const& calculation) {
 	u16 total = 0;
 	for (u8 i = 0; i < calculation.part_count; i++) {
-		total += getPartClocks(calculation.parts[i]);
+		total += getPartClocks(machine, calculation.parts[i]);
 	}
 	return total;
 }
 
-void explainClocks(FILE* f, Clock_Calculation const& calculation) {
+Clock_Evaluation evaluateClocks(Machine const& machine, Clock_Calculation const& calculation) {
+	Clock_Evaluation evaluation = {};
+	for (u8 i = 0; i < calculation.part_count; i++) {
+		evaluation.parts[i] = getPartClocks(machine, calculation.parts[i]);
+		evaluation.total += evaluation.parts[i];
+	}
+	return evaluation;
+}
+
+void explainClocks(FILE* f, Clock_Calculation const& calculation, Clock_Evaluation const& evaluation, u64 const totalClocks) {
 	if (calculation.part_count == 1 && calculation.parts[0].type == Clock_None) {
-		fprintf(f, "Clocks: +0 = %llu (unimplemented) | ", gClocks);
+		fprintf(f, "Clocks: +0 = %llu (unimplemented) | ", totalClocks);
 		return;
 	}
 
-	u8 const totalClocks = getTotalClocks(calculation);
-	gClocks += totalClocks;
-	fprintf(f, "Clocks: +%d = %llu (", totalClocks, gClocks);
+	fprintf(f, "Clocks: +%d = %llu (", evaluation.total, totalClocks);
 
-	for (u8 i = 0; i < calculation.part_count; i++) {
-		if (i > 0) fprintf(f, " + ");
+	for (u8 i = 0, printed = 0; i < calculation.part_count; i++) {
 		auto const part = calculation.parts[i];
-		u8 const clocks = getPartClocks(part);
+		u8 const clocks = evaluation.parts[i];
+		if (part.type == Clock_16bitTransfer && clocks == 0) continue;
+		if (printed++ > 0) fprintf(f, " + ");
 		switch (part.type) {
 			case Clock_Inst:  fprintf(f, "%d", clocks);                          break;
 			case Clock_EA:    fprintf(f, "%dea", clocks);                        break;
@@ -400,168 +399,151 @@ Clock_Calculation getInstructionClocksCalculation(Instruction const& inst) {
 	return calculation;
 }
 
-int Decoder_Context::printEffectiveAddressBase(EffectiveAddress::Base const base) const {
-	using namespace EffectiveAddress;
-	int constexpr BASE_INDEX_LEN = sizeof("?? + ??")-1;
-
-	if (shouldDecorateOutput()) {
-		switch (base) {
-			case Base::Direct: return 0;
-			#define X(R) REGISTER_COLOR R ASCII_COLOR_END
-			case Base::bx_si: print(X("bx") " + " X("si")); return BASE_INDEX_LEN;
-			case Base::bx_di: print(X("bx") " + " X("di")); return BASE_INDEX_LEN;
-			case Base::bp_si: print(X("bp") " + " X("si")); return BASE_INDEX_LEN;
-			case Base::bp_di: print(X("bp") " + " X("di")); return BASE_INDEX_LEN;
-			#undef X
-
-			case Base::si: case Base::di: case Base::bp: case Base::bx: {
-				print(REGISTER_COLOR);
-				int const n = _print(base2string(base));
-				print(ASCII_COLOR_END);
-				return n;
-			}
+Opcode_Entry const* decodeNext(Decoder_Context& decoder, Decoded_Instruction& decoded) {
+	u32 const offset = decoder.bytesRead;
+	u8 byte; decoder.advance(byte);
+	Opcode_Entry const& entry = lookupOpcode(decoder, byte);
+	if (entry.decode == nullptr) {
+		return nullptr;
+	}
+	// The decode procs would assert reading past the end.
+	if (offset + getInstructionLength(decoder.binaryBytes, offset) > decoder.binaryBytes.count) {
+		return nullptr;
+	}
+	decoded = entry.decode(decoder, byte, entry);
+	decoded.offset = offset;
+	decoded.size = decoder.byteStack.count;
+	return &entry;
+}
 
-			default: return 0;
+bool decodeProgram(Slice<u8> const binaryBytes, Instruction_Stream& stream) {
+	Decoder_Context decoder(binaryBytes);
+	while (decoder.bytesRead < binaryBytes.count) {
+		Decoded_Instruction decoded;
+		if (decodeNext(decoder, decoded) == nullptr) {
+			stream.unrecognizedOffset = decoder.bytesRead - 1;
+			stream.truncated = isTruncatedAt(binaryBytes, stream.unrecognizedOffset);
+			return false;
 		}
+		stream.push(decoded);
+		decoder.resetByteStack();
 	}
-	return _print(base2string(base));
+	return true;
 }
 
-int Decoder_Context::printInstOperand(Instruction_Operand const& operand, Instruction_Operand_Prefix prefix) const {
-	if (operand.type == Instruction_Operand_Type::None) return 0;
-	int n = 0;
-
-	switch (prefix) {
-        case Instruction_Operand_Prefix::Byte:
-        case Instruction_Operand_Prefix::Word:
-			if (shouldDecorateOutput()) print(INST_PREFIX_COLOR);
-			n+=_print("%s ", InstOpPrefixName[static_cast<u8>(prefix)]);
-			if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-			break;
-		default: break;
+// Every IP gets decoded once, loops run out of the cache afterwards.
+static Cached_Instruction const* fetchNext(Machine const& machine, Decoder_Context& decoder, Instruction_Cache& cache) {
+	u16 const ip = getIP(machine);
+	if (Cached_Instruction const* cached = cache.find(ip)) {
+		decoder.replay(cached->decoded.size);
+		return cached;
 	}
+	Decoded_Instruction decoded;
+	Opcode_Entry const* entry = decodeNext(decoder, decoded);
+	if (entry == nullptr) return nullptr;
+	return &cache.insert(ip, decoded, entry->exec);
+}
 
-	switch (operand.type) {
-        case Instruction_Operand_Type::Immediate: {
-        	if (shouldDecorateOutput()) print(NUMBER_COLOR);
-        	if (operand.immediate.wide) {
-        		n+=_print("%" PRIi16, operand.immediate.word);
-        	} else {
-        		n+=_print("%" PRIi8, operand.immediate.byte);
-        	}
-        	if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-        } break;
-
-        case Instruction_Operand_Type::Register: {
-        	if (shouldDecorateOutput()) print(REGISTER_COLOR);
-			n+=_print(getRegisterName(operand.reg));
-        	if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-        } break;
-
-        case Instruction_Operand_Type::EffectiveAddress: {
-			fputc('[', outFile); n++;
-        	bool const hasBase = operand.address.base != EffectiveAddress::Base::Direct;
-        	if (hasBase) {
-        		n += printEffectiveAddressBase(operand.address.base);
-        	}
-        	if (operand.address.displacement.wide) {
-                if (operand.address.displacement.word > 0) {
-					if (hasBase) n+=_print(" + ");
-					if (shouldDecorateOutput()) print(NUMBER_COLOR);
-					n+=_print("%" PRIi16, operand.address.displacement.word);
-					if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-                } else if (operand.address.displacement.word < 0) {
-					n+=_print(hasBase ? " - " : "-");
-					if (shouldDecorateOutput()) print(NUMBER_COLOR);
-					n+=_print("%" PRIi16, -operand.address.displacement.word);
-					if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-                }
-        	} else {
-                if (operand.address.displacement.byte > 0) {
-					if (hasBase) n+=_print(" + ");
-					if (shouldDecorateOutput()) print(NUMBER_COLOR);
-					n+=_print("%" PRIi8, operand.address.displacement.byte);
-					if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-                } else if (operand.address.displacement.byte < 0) {
-					n+=_print(hasBase ? " - " : "-");
-					if (shouldDecorateOutput()) print(NUMBER_COLOR);
-					n+=_print("%" PRIi16, -operand.address.displacement.byte);
-					if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-                }
-        	}
-			fputc(']', outFile); n++;
-        } break;
-
-		case Instruction_Operand_Type::Jump: {
-			// The offset gets added 2 because the jump instructions take up 2 bytes.
-			i8 const disp = static_cast<i8>(operand.jump_offset + 2);
-			if (disp > 0) {
-				n+=_print("$+");
-				if (shouldDecorateOutput()) print(NUMBER_COLOR);
-				n+=_print("%" PRIi8, disp);
-				if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-				n+=_print("+");
-				if (shouldDecorateOutput()) print(NUMBER_COLOR);
-				n+=_print("%" PRIi8, 0);
-				if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-			} else if (disp < 0) {
-				n+=_print("$-");
-				if (shouldDecorateOutput()) print(NUMBER_COLOR);
-				n+=_print("%" PRIi8, -disp);
-				if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-				n+=_print("+");
-				if (shouldDecorateOutput()) print(NUMBER_COLOR);
-				n+=_print("%" PRIi8, 0);
-				if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-			} else {
-				n+=_print("$+");
-				if (shouldDecorateOutput()) print(NUMBER_COLOR);
-				n+=_print("%" PRIi8, 0);
-				if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-			}
-		} break;
+// code:    The code segment as Machine::load() returns it.
+// firstIP: Where the program starts in it.
+static bool simulateProgram(Formatter& formatter, Machine& machine, Slice<u8> const code, u16 const firstIP, Simulation_Stats& stats) {
+	Decoder_Context decoder(code);
+	Instruction_Cache cache(code.count);
+	auto const start = std::chrono::high_resolution_clock::now();
+
+	for (u16 ip = getIP(machine); ip >= firstIP && ip < code.count; ip = getIP(machine)) {
+		decoder.bytesRead = ip;
+		Cached_Instruction const* cached = fetchNext(machine, decoder, cache);
+		if (cached == nullptr) {
+			formatter.printDecodeFailure(code, decoder.bytesRead - 1);
+			return false;
+		}
+
+		Exec_Trace trace = {};
+		trace.clocks = evaluateClocks(machine, cached->clocks);
+		machine.clocks += trace.clocks.total;
+		trace.totalClocks = machine.clocks;
+		trace.oldIP = getIP(machine);
+		incrementIP(machine, cached->decoded.size);
+		Decoded_Instruction const decoded = cached->decoded.unpack();
+		cached->exec(machine, decoder, decoded.inst, trace);
+		trace.newIP = getIP(machine);
+		decoder.resetByteStack();
+		stats.instructions++;
 
-        default: unreachable();
+		formatter.printExecuted(decoded, cached->clocks, trace);
 	}
-	return n;
+
+	std::chrono::duration<f64> const elapsed = std::chrono::high_resolution_clock::now() - start;
+	stats.seconds = elapsed.count();
+	stats.clocks = machine.clocks;
+	return true;
 }
 
-bool decodeOrSimulate(FILE* outFile, Slice<u8> const binaryBytes, bool const exec, bool const showClocks) {
-	Decoder_Context decoder(outFile, binaryBytes, exec, showClocks);
-	decoder.printBitsHeader();
+bool decodeOrSimulate(FILE* outFile, Machine& machine, Slice<u8> const binaryBytes, bool const exec, bool const showClocks, bool const quiet,
+                      Simulation_Stats* const outStats, u32 const decodeThreads, bool const jit, Load_Address const loadAddress) {
+	Formatter formatter(outFile, showClocks);
+	if (!quiet) {
+		formatter.printBitsHeader();
+	}
 
-	memset(gMemory, 0, sizeof(gMemory));
-	memset(gRegisterValues, 0, sizeof(gRegisterValues));
-	gClocks = 0;
+	machine.reset();
 
-	while (decoder.bytesRead < binaryBytes.count) {
-		u8 byte; decoder.advance(byte);
+	if (exec && !loadAddress.fits(binaryBytes.count)) {
+		eprintfln(LOG_ERROR_STRING": The %zu bytes of the program don't fit in memory at %04X:%04X.", binaryBytes.count, loadAddress.cs, loadAddress.ip);
+		return false;
+	}
 
-		if (isByte_MOV(byte)) {
-			decode_MOV(decoder, byte);
+	if (exec && quiet) {
+		Simulation_Stats stats = {};
+		Slice<u8> const code = machine.load(binaryBytes, loadAddress);
+		Interpreter interpreter(machine, code, loadAddress.ip);
+		// Only a program that decodes all the way through, without a byte that
+		// isn't recognized or an instruction cut off by the end, can be analyzed,
+		// the rest runs with every add, sub and cmp setting the flags.
+		Instruction_Stream stream;
+		Flag_Liveness liveness;
+		if (decodeProgram(binaryBytes, stream)) {
+			Control_Flow_Graph cfg;
+			buildControlFlowGraph(stream, cfg);
+			analyzeFlagLiveness(stream, cfg, cast(u32)binaryBytes.count, liveness);
+			interpreter.flagLiveness = &liveness;
 		}
-		else if (isByte_Jump(byte)) {
-			decode_Jump(decoder, byte);
+		std::unique_ptr<Jit> compiler;
+		if (jit && JIT_SUPPORTED) {
+			compiler = std::make_unique<Jit>();
+			interpreter.jit = compiler.get();
 		}
-		else if (isByte_common_inst(decoder, byte)) {
-			decode_common_inst(decoder, byte);
-		}
-		else {
-			eprintf(LOG_ERROR_STRING": Had an unrecognized byte (" ASCII_COLOR_B_RED);
-			printBits(stderr, byte, 8);
-			eprintfln(ASCII_COLOR_END")");
+		if (!interpreter.run(stats)) {
+			formatter.printDecodeFailure(code, interpreter.unrecognizedOffset);
 			return false;
 		}
-		incrementIP(decoder.byteStack.count);
-		decoder.resetByteStack();
+		formatter.println("Final registers:");
+		formatter.printRegistersLN(machine);
+		formatter.printSimulationStats(stats);
+		if (outStats) *outStats = stats;
+		return true;
 	}
 
-	if (decoder.exec) {
-		decoder.println("\nFinal registers:");
-		decoder.printRegistersLN();
+	if (exec) {
+		Simulation_Stats stats = {};
+		Slice<u8> const code = machine.load(binaryBytes, loadAddress);
+		if (!simulateProgram(formatter, machine, code, loadAddress.ip, stats)) return false;
+		formatter.println("\nFinal registers:");
+		formatter.printRegistersLN(machine);
+		if (outStats) *outStats = stats;
+		return true;
 	}
 
-	return true;
+	Instruction_Stream stream;
+	bool const ok = decodeProgramParallel(binaryBytes, stream, decodeThreads);
+	for (Packed_Decoded_Instruction const& packed: stream.items) {
+		formatter.printDecoded(packed.unpack(), binaryBytes.ptr + packed.offset);
+	}
+	if (!ok) {
+		formatter.printDecodeFailure(binaryBytes, stream.unrecognizedOffset);
+	}
+	return ok;
 }
 
 void printBits(FILE* outFile, u8 const byte, int const count) {
@@ -21,6 +21,10 @@
 #define REGISTER_COLOR     ASCII_COLOR_YELLOW
 
 #define MAX_BYTES_PER_INSTRUCTION_8086 6
+#define MEMORY_SIZE_8086 (1024 * 1024)
+
+struct Machine;
+
 struct Byte_Stack_8086 {
 	u8 items[MAX_BYTES_PER_INSTRUCTION_8086];
 	i8 count;
@@ -75,9 +79,17 @@ struct RegisterPair {
 	 (reg).type == Register::ss || \
 	 (reg).type == Register::es)
 
-u16 getRegisterValue(RegisterInfo const& reg);
-void setRegisterValue(RegisterInfo const& reg, u16 value);
-void incrementRegister(RegisterInfo const& reg, i16 increment);
+// Where a register lives in Register_File::bytes, and which of the word read from there it uses.
+constexpr u8 getRegisterOffset(RegisterInfo const& reg) {
+	return 2 * RegToID(reg.type) + (reg.usage == RegisterUsage::h);
+}
+constexpr u16 getRegisterMask(RegisterInfo const& reg) {
+	return (reg.usage == RegisterUsage::x) ? 0xFFFF : 0x00FF;
+}
+
+u16 getRegisterValue(Machine const& machine, RegisterInfo const& reg);
+void setRegisterValue(Machine& machine, RegisterInfo const& reg, u16 value);
+void incrementRegister(Machine& machine, RegisterInfo const& reg, i16 increment);
 const char* getRegisterName(RegisterInfo const& reg);
 
 struct Immediate {
@@ -109,7 +121,7 @@ namespace EffectiveAddress {
 		bool wide;
 	};
     const char* base2string(Base base);
-	u32 getInnerValue(Info const& info);
+	u32 getInnerValue(Machine const& machine, Info const& info);
 	u8 getClocks(Info const& info);
 
 	#define is_Effective_Address_Direct(MOD, R_M) ((MOD) == 0b00 && (R_M) == 0b110)
@@ -137,11 +149,20 @@ enum Clock_Calculation_Part_Type : u8 {
 	Clock_16bitTransfer,
 };
 
+// A 16-bit transfer only costs extra when the address is odd, so the part
+// keeps the address around and it gets checked when the part is evaluated.
+// That way a calculation only depends on the instruction, not on the registers.
+struct Clock_Transfer {
+	EffectiveAddress::Info address;
+	u8 count;
+};
+
 struct Clock_Calculation_Part {
 	union {
 		u16 value;
 		struct { u8 A; u8 B; };
 		EffectiveAddress::Info address;
+		Clock_Transfer transfer;
 	};
 	Clock_Calculation_Part_Type type;
 };
@@ -165,20 +186,27 @@ struct Clock_Calculation {
 	ClocksPush16bitTransfer(calc, ea, transfers);                            \
 } while (0)
 
-#define ClocksPush16bitTransfer(calc, ea, transfers) do {             \
-	bool const is_odd = EffectiveAddress::getInnerValue(ea) % 2 == 1; \
-	bool const is_wide = (ea).wide;                                   \
-	if (is_wide && is_odd) {                                          \
-		ClocksPush(calc, (Clock_Calculation_Part{                     \
-			.value=transfers,                                         \
-			.type=Clock_16bitTransfer})                               \
-		);                                                            \
-	}                                                                 \
+#define ClocksPush16bitTransfer(calc, ea, transfers) do {                   \
+	if ((ea).wide) {                                                        \
+		ClocksPush(calc, (Clock_Calculation_Part{                           \
+			.transfer=Clock_Transfer{.address=ea, .count=transfers},        \
+			.type=Clock_16bitTransfer})                                     \
+		);                                                                  \
+	}                                                                       \
 } while (0)
 
-u8 getPartClocks(Clock_Calculation_Part const& part);
-u16 getTotalClocks(Clock_Calculation const& calculation);
-void explainClocks(FILE* f, Clock_Calculation const& calculation);
+// The clocks of every part at the moment the instruction ran.
+struct Clock_Evaluation {
+	u8 parts[4];
+	u16 total;
+};
+
+u8 getPartClocks(Machine const& machine, Clock_Calculation_Part const& part);
+// The same without the machine, 0 for a Clock_16bitTransfer since only the address tells.
+u8 getStaticPartClocks(Clock_Calculation_Part const& part);
+u16 getTotalClocks(Machine const& machine, Clock_Calculation const& calculation);
+Clock_Evaluation evaluateClocks(Machine const& machine, Clock_Calculation const& calculation);
+void explainClocks(FILE* f, Clock_Calculation const& calculation, Clock_Evaluation const& evaluation, u64 totalClocks);
 
 namespace Jumps {
 	typedef i8 Offset;
@@ -222,6 +250,7 @@ struct Instruction_Operand {
 #define IsOperandImm(operand) ((operand).type == Instruction_Operand_Type::Immediate)
 #define IsOperandMem(operand) ((operand).type == Instruction_Operand_Type::EffectiveAddress)
 #define IsOperandRegPair(operand) ((operand).type == Instruction_Operand_Type::RegisterPair)
+#define IsOperandJump(operand) ((operand).type == Instruction_Operand_Type::Jump)
 
 #define IsOperandReg16(operand) (IsOperandReg(operand) && (operand).reg.usage == RegisterUsage::x)
 #define IsOperandMem16(operand) (IsOperandMem(operand) && (operand).address.wide)
@@ -250,9 +279,9 @@ struct Instruction_Operand {
 	GetInstOpTypeName((inst).dst), \
 	GetInstOpTypeName((inst).src)
 
-String_Builder getInstOpName(Instruction_Operand const& operand);
-u32  getInstOpValue(Instruction_Operand const& operand);
-void setInstOpValue(Instruction_Operand const& operand, u32 value);
+String_Builder getInstOpName(Machine const& machine, Instruction_Operand const& operand);
+u32  getInstOpValue(Machine const& machine, Instruction_Operand const& operand);
+void setInstOpValue(Machine& machine, Instruction_Operand const& operand, u32 value);
 
 #define InstOpNone Instruction_Operand{ .type = Instruction_Operand_Type::None }
 
@@ -302,6 +331,9 @@ enum Instruction_Type : u8 {
 	Inst_Count,
 };
 
+// The jumps are listed together in instructions.inl, from jo to jcxz.
+#define IsInstJump(type) ((type) >= Inst_jo && (type) <= Inst_jcxz)
+
 struct Instruction {
 	Instruction_Operand dst;
 	Instruction_Operand src;
@@ -327,12 +359,30 @@ Instruction_Operand_Prefix getInstDstPrefix(Instruction const& inst);
 namespace FlagsRegister {
     enum struct Bit : u16 { CF = 0, PF = 2, AF = 4, ZF = 6, SF, OF, IF, DF, TF};
     constexpr Bit BitList[] = { Bit::CF, Bit::PF, Bit::AF, Bit::ZF, Bit::SF, Bit::OF, Bit::IF, Bit::DF, Bit::TF };
-	void setBit(Bit const& bit, bool value = true);
-	u16 get();
-	bool getBit(Bit const& bit, u16 flags);
-	bool getBit(Bit const& bit);
+	inline void setBit(Machine& machine, Bit const& bit, bool value = true);
+	inline u16 get(Machine& machine);
+	inline bool getBit(Bit const& bit, u16 flags);
+	inline bool getBit(Machine const& machine, Bit const& bit);
+
+	// Arithmetic instructions don't set the flags, they leave what they did in
+	// Machine::pendingFlags and each flag is worked out from it once something reads it.
+	enum struct Pending_Op : u8 { None = 0, Add, Sub };
+	struct Pending {
+		u16 A, B, result;
+		Pending_Op op;
+		bool wide;
+	};
+	inline void setPending(Machine& machine, Pending_Op op, u16 A, u16 B, u16 result, bool wide);
+	inline void materialize(Machine& machine);
+
+	// The flags as they were at some point, for a trace to work out when it gets printed.
+	struct Snapshot {
+		u16 flags;
+		Pending pending;
+	};
+	inline Snapshot snapshot(Machine const& machine);
+	inline u16 get(Snapshot const& snapshot);
 	void printSet(FILE* outFile, u16 flags);
-	void printSet(FILE* outFile);
     const char* getFullName(Bit const& bit);
     char getLetter(Bit const& bit);
 }
@@ -400,39 +450,193 @@ constexpr const char* RegisterFullNames[RegisterCount] = {
 	"Extra Segment", "Instruction Pointer", "Flag",
 };
 
-extern u16 gRegisterValues[RegisterCount];
-extern u8 gMemory[1024 * 1024];
-extern u64 gClocks;
+// Every register is a word with its low byte first, so ah is the byte after
+// al and an operand can be kept as a byte offset into the block plus a mask.
+union Register_File {
+	u16 words[RegisterCount];
+	u8 bytes[RegisterCount * 2];
+};
+static_assert(sizeof(Register_File) == RegisterCount * 2);
+
+// Where a program gets loaded to run it, and so what CS:IP starts out as.
+struct Load_Address {
+	u16 cs, ip;
+
+	[[nodiscard]] u32 getPhysical() const {
+		return (cast(u32)cs << 4) + ip;
+	}
+
+	// Whether that many bytes fit from here on without leaving the segment or the memory.
+	[[nodiscard]] bool fits(size_t const size) const {
+		return ip + size <= 0x10000 && getPhysical() + size <= MEMORY_SIZE_8086;
+	}
+};
+
+// Everything a simulation changes. Nothing else is shared between
+// simulations, so separate machines can run on separate threads.
+struct Machine {
+	Register_File registers;
+	FlagsRegister::Pending pendingFlags;
+	u64 clocks;
+	u8 memory[MEMORY_SIZE_8086];
+
+	void reset() {
+		memset(this, 0, sizeof(*this));
+	}
+
+	// Copies the program to address and points CS:IP at its first byte.
+	// Returns the code segment from its start to the end of the program, which
+	// is what instructions get fetched from, so an offset into it is an IP.
+	Slice<u8> load(Slice<u8> const& program, Load_Address const address) {
+		assertTrue(address.fits(program.count));
+		memcpy(memory + address.getPhysical(), program.ptr, program.count);
+		registers.words[RegToID(Register::cs)] = address.cs;
+		registers.words[RegToID(Register::ip)] = address.ip;
+		return Slice<u8>(memory + address.getPhysical() - address.ip, address.ip + program.count);
+	}
+};
 
 Register getReg(const char* reg);
 
-force_inline inline void incrementIP(i16 const value) {
-	incrementRegister(RegX(ip), value);
+constexpr u8 Count1s(u8 const byte) {
+	return ((byte >> 0) & 0b1) + ((byte >> 1) & 0b1) +
+	       ((byte >> 2) & 0b1) + ((byte >> 3) & 0b1) +
+	       ((byte >> 4) & 0b1) + ((byte >> 5) & 0b1) +
+	       ((byte >> 6) & 0b1) + ((byte >> 7) & 0b1);
 }
 
-force_inline inline u16 getIP() {
-	return gRegisterValues[RegToID(Register::ip)];
+namespace FlagsRegister {
+	#define FlagMask(bit) (1 << static_cast<u16>(Bit::bit))
+	constexpr u16 ArithmeticMask = FlagMask(CF) | FlagMask(PF) | FlagMask(AF) |
+	                               FlagMask(ZF) | FlagMask(SF) | FlagMask(OF);
+
+	inline void setPending(Machine& machine, Pending_Op const op, u16 const A, u16 const B, u16 const result, bool const wide) {
+		machine.pendingFlags = {.A = A, .B = B, .result = result, .op = op, .wide = wide};
+	}
+
+	// Only meant for the bits in ArithmeticMask.
+	inline bool computeBit(Bit const& bit, Pending const& p) {
+		u16 const mask = p.wide ? 0xFFFF : 0xFF;
+		u16 const sign = p.wide ? 0x8000 : 0x80;
+		u16 const A = p.A & mask, B = p.B & mask, result = p.result & mask;
+		bool const add = p.op == Pending_Op::Add;
+		switch (bit) {
+			case Bit::CF: return add ? (cast(u32)A + B > mask) : (A < B);
+			case Bit::PF: return Count1s(result & 0xFF) % 2 == 0;
+			case Bit::AF: return (A ^ B ^ result) & 0x10;
+			case Bit::ZF: return result == 0;
+			case Bit::SF: return result & sign;
+			case Bit::OF: return add ? ((A ^ result) & (B ^ result) & sign)
+			                         : ((A ^ B) & (A ^ result) & sign);
+			default: unreachable();
+		}
+	}
+
+	// flags with what pending says in place of the arithmetic bits.
+	inline u16 resolve(u16 flags, Pending const& pending) {
+		if (pending.op == Pending_Op::None) return flags;
+		flags &= ~ArithmeticMask;
+		for (Bit const bit: BitList) {
+			if ((ArithmeticMask >> static_cast<u16>(bit)) & 1 && computeBit(bit, pending)) {
+				flags |= 1 << static_cast<u16>(bit);
+			}
+		}
+		return flags;
+	}
+
+	inline void materialize(Machine& machine) {
+		Pending& pending = machine.pendingFlags;
+		if (pending.op == Pending_Op::None) return;
+		machine.registers.words[RegToID(Register::fl)] = resolve(machine.registers.words[RegToID(Register::fl)], pending);
+		pending.op = Pending_Op::None;
+	}
+
+	inline Snapshot snapshot(Machine const& machine) {
+		return Snapshot{.flags = machine.registers.words[RegToID(Register::fl)], .pending = machine.pendingFlags};
+	}
+
+	inline u16 get(Snapshot const& snapshot) {
+		return resolve(snapshot.flags, snapshot.pending);
+	}
+
+	inline void setBit(Machine& machine, Bit const& bit, bool const value) {
+		materialize(machine);
+		u16 const b = static_cast<u16>(bit);
+		if (value) {
+			machine.registers.words[RegToID(Register::fl)] |= (1 << b);
+		} else {
+			machine.registers.words[RegToID(Register::fl)] &= ~(1 << b);
+		}
+	}
+
+	inline u16 get(Machine& machine) {
+		materialize(machine);
+		return machine.registers.words[RegToID(Register::fl)];
+	}
+
+	inline bool getBit(Bit const& bit, u16 const flags) {
+		u16 const b = static_cast<u16>(bit);
+		return (flags >> b) & 1;
+	}
+
+	inline bool getBit(Machine const& machine, Bit const& bit) {
+		Pending const& pending = machine.pendingFlags;
+		if (pending.op != Pending_Op::None && (ArithmeticMask >> static_cast<u16>(bit)) & 1) {
+			return computeBit(bit, pending);
+		}
+		return getBit(bit, machine.registers.words[RegToID(Register::fl)]);
+	}
+	#undef FlagMask
 }
 
-bool decodeOrSimulate(FILE* outFile, Slice<u8> binaryBytes, bool exec, bool showClocks);
+force_inline inline void incrementIP(Machine& machine, i16 const value) {
+	incrementRegister(machine, RegX(ip), value);
+}
+
+force_inline inline u16 getIP(Machine const& machine) {
+	return machine.registers.words[RegToID(Register::ip)];
+}
+
+struct Simulation_Stats {
+	u64 instructions;
+	u64 clocks;
+	f64 seconds;
+};
+
+// quiet:         Executes without printing a line per instruction, only the final
+//                registers and the Simulation_Stats.
+// outStats:      Where to also leave the Simulation_Stats of an execution, if anywhere.
+// decodeThreads: How many threads a big binary gets split between when it's only decoded.
+// jit:           Compiles the hot blocks of a quiet execution, see jit.h.
+// loadAddress:   Where an execution loads the program into Machine::memory
+//                and starts running it. It stops once the IP leaves the program.
+bool decodeOrSimulate(FILE* outFile, Machine& machine, Slice<u8> binaryBytes, bool exec, bool showClocks, bool quiet,
+                      Simulation_Stats* outStats = nullptr, u32 decodeThreads = 1, bool jit = false, Load_Address loadAddress = {});
 void printBits(FILE* outFile, u8 byte, int count);
 void printBits(FILE* outFile, u8 byte, int count, char ending);
 
+// What executing an instruction did, kept so the trace can be printed afterwards.
+enum struct Exec_Trace_Kind : u8 { None = 0, Write, Jump, InvalidOperands };
+
+struct Exec_Trace {
+	Clock_Evaluation clocks;
+	u64 totalClocks;
+	u32 dstAddress;
+	u32 oldValue, newValue;
+	u16 oldIP, newIP;
+	FlagsRegister::Snapshot oldFlags, newFlags;  // Only taken when setsFlags.
+	u16 oldCX, newCX;
+	Exec_Trace_Kind kind;
+	Jumps::Outcome outcome;
+	bool setsFlags;
+};
+
 struct Decoder_Context {
-	FILE* const outFile;
 	Slice<u8> const& binaryBytes;
 	Byte_Stack_8086 byteStack = {};
 	i64 bytesRead = 0;
-	u64 instructionCounter = 0;
-	bool exec = false;
-	bool showClocks = false;
-
-	explicit Decoder_Context(FILE* OutFile, Slice<u8> const& BinaryBytes, bool const Exec, bool const ShowClocks):
-		outFile(OutFile), binaryBytes(BinaryBytes), exec(Exec), showClocks(ShowClocks) {}
 
-	[[nodiscard]] force_inline bool shouldDecorateOutput() const {
-		return isatty(fileno(outFile));
-	}
+	explicit Decoder_Context(Slice<u8> const& BinaryBytes): binaryBytes(BinaryBytes) {}
 
 	void advance(u8& currentByte) {
 		assertTrue(byteStack.count + 1 <= MAX_BYTES_PER_INSTRUCTION_8086);
@@ -500,131 +704,14 @@ struct Decoder_Context {
 		}
 	}
 
-	void explainClocksUpdate(Instruction const& inst) const {
-		if (showClocks) {
-			explainClocks(outFile, getInstructionClocksCalculation(inst));
-		}
-	}
-
-	void printSR(u8 const SR, char const ending) const {
-		fprintf(outFile, "SR:");
-		printBits(outFile, SR, 2, ending);
-	}
-
-	void printMOD(u8 const MOD, char const ending) const {
-		fprintf(outFile, "MOD:");
-		printBits(outFile, MOD, 2, ending);
-	}
-
-	void printREG(u8 const REG, char const ending) const {
-		fprintf(outFile, "REG:");
-		printBits(outFile, REG, 3, ending);
-	}
-
-	void printR_M(u8 const R_M, char const ending) const {
-		fprintf(outFile, "R/M:");
-		printBits(outFile, R_M, 3, ending);
-	}
-
-	void printlnFlags(u16 const oldFlags) const {
-		FlagsRegister::printSet(outFile, oldFlags);
-		print("->");
-		FlagsRegister::printSet(outFile);
-		fputc('\n', outFile);
-		if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-	}
-
-	void printlnIP() const {
-		printIP();
-		fputc('\n', outFile);
-		if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-    }
-
-	void printIP(char const* ending) const {
-		printIP();
-		fputs(ending, outFile);
-    }
-
-	void printIP() const {
-		u16 const ip = gRegisterValues[RegToID(Register::ip)];
-		print("ip:0x%x->0x%x", ip, ip+byteStack.count);
-    }
-
-	void printRegistersLN() const {
-		for (size_t i = 0; i < RegisterCount; i++) {
-			RegisterInfo const reg = RegisterList[i];
-			const char* name = RegisterNames[i];
-			u16 const value = getRegisterValue(reg);
-			if (value == 0) continue;
-			if (reg.type == Register::fl) {
-				print("%8s: ", "flags", value, value);
-				FlagsRegister::printSet(outFile);
-				fputc('\n', outFile);
-			} else {
-				println("%8s: 0x%04x (%d)", name, value, value);
-			}
-		}
-	}
-
-	[[nodiscard]] int printEffectiveAddressBase(EffectiveAddress::Base base) const;
-	[[nodiscard]] int printInstOperand(Instruction_Operand const& operand, Instruction_Operand_Prefix prefix) const;
-
-	void print(const char* fmt, ...) const {
-		va_list args;
-		va_start(args, fmt);
-		vfprintf(outFile, fmt, args);
-		va_end(args);
-	}
-
-	int _print(const char* fmt, ...) const {
-		va_list args;
-		va_start(args, fmt);
-		int const n = vfprintf(outFile, fmt, args);
-		va_end(args);
-		return n;
-	}
-
-	void println(const char* fmt, ...) const {
-		va_list args;
-		va_start(args, fmt);
-		vfprintf(outFile, fmt, args);
-		fputc('\n', outFile);
-		va_end(args);
-	}
-
-	void printBitsHeader() {
-		printInst(Instruction{
-			.dst = InstOpImmediate(false, 16),
-			.type=Inst_bits,
-		});
-		fputc('\n', outFile);
-	}
-
-	void printInst(Instruction const& inst) {
-		assertTrue(inst.dst.type != Instruction_Operand_Type::None);
-		if (shouldDecorateOutput()) print(MNEMONIC_COLOR);
-		int n = _print("%s ", GetInstMnemonic(inst));
-		if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-		n += printInstOperand(inst.dst, getInstDstPrefix(inst));
-		if (inst.src.type != Instruction_Operand_Type::None) {
-			n += _print(", ");
-			n += printInstOperand(inst.src, Instruction_Operand_Prefix::None);
-		}
-		for (int i = 0; i < INSTRUCTION_LINE_SIZE-n; i++) {
-			fputc(' ', outFile);
-		}
-		if (shouldDecorateOutput()) print(COMMENT_COLOR);
-		print(" ;(%d) ", ++instructionCounter);
-		explainClocksUpdate(inst);
-	}
-
-	void printByteStack() const {
-		for (size_t i = 0; i < byteStack.count; i++) {
-			if (i > 0) fputc(' ', outFile);
-			printBits(outFile, byteStack.items[i], 8);
-		}
-		if (shouldDecorateOutput()) print(ASCII_COLOR_END);
-		fputc('\n', outFile);
+	// Consumes an instruction that was already decoded, as if it had been advanced through.
+	void replay(u8 const size) {
+		assertTrue(byteStack.count == 0);
+		assertTrue(size <= MAX_BYTES_PER_INSTRUCTION_8086);
+		assertTrue(bytesRead + size <= binaryBytes.count);
+		memcpy(byteStack.items, binaryBytes.ptr + bytesRead, size);
+		byteStack.count = size;
+		bytesRead += size;
 	}
 
 	void resetByteStack() {
@@ -632,4 +719,3 @@ struct Decoder_Context {
 		byteStack.count = 0;
 	}
 };
-
@@ -0,0 +1,140 @@
+#include "encoder.h"
+
+#include "opcode_table.h"
+
+u8 getRegisterEncoding(RegisterInfo const& reg) {
+	if (IsRegisterSegment(reg)) {
+		for (u8 SR = 0; SR < StaticArrayCount(SR_Table); SR++) {
+			if (SR_Table[SR].reg.type == reg.type) return SR;
+		}
+	} else {
+		bool const W = reg.usage == RegisterUsage::x;
+		for (u8 REG = 0; REG < StaticArrayCount(REG_Table); REG++) {
+			if (REG_Table[REG][W].reg.type == reg.type && REG_Table[REG][W].reg.usage == reg.usage) return REG;
+		}
+	}
+	unreachable();
+}
+
+u8 getEffectiveAddressR_M(EffectiveAddress::Base const base) {
+	if (base == EffectiveAddress::Base::Direct) return 0b110;
+	for (u8 R_M = 0; R_M < StaticArrayCount(Effective_Address_Table); R_M++) {
+		if (Effective_Address_Table[R_M] == base) return R_M;
+	}
+	unreachable();
+}
+
+struct Encoder_Output {
+	u8* items;
+	u8 count;
+
+	void push08(u16 const value) {
+		assertTrue(count + 1 <= MAX_BYTES_PER_INSTRUCTION_8086);
+		items[count++] = cast(u8)value;
+	}
+
+	void push16(u16 const value) {
+		push08(value & 0xFF);
+		push08(value >> 8);
+	}
+
+	void pushImmediate(Immediate const& immediate) {
+		if (immediate.wide) push16(immediate.word);
+		else                push08(cast(u8)immediate.byte);
+	}
+
+	// The ModRM byte and the displacement, which is as wide as MOD says.
+	void pushModRM(u8 const MOD, u8 const REG, Instruction_Operand const& rm) {
+		if (IsOperandReg(rm)) {
+			assertTrue(is_MOD_Register_Mode(MOD));
+			push08(MOD << 6 | REG << 3 | getRegisterEncoding(rm.reg));
+			return;
+		}
+		assertTrue(IsOperandMem(rm) && !is_MOD_Register_Mode(MOD));
+		u8 const R_M = getEffectiveAddressR_M(rm.address.base);
+		push08(MOD << 6 | REG << 3 | R_M);
+		switch (get_Disp_Type(MOD, R_M)) {
+			case Disp_None:   break;
+			case Disp_08_bit: push08(cast(u8)rm.address.displacement.byte); break;
+			case Disp_16_bit: push16(rm.address.displacement.word); break;
+			default: unreachable();
+		}
+	}
+};
+
+u8 encodeInstruction(Decoded_Instruction const& decoded, u8* const out) {
+	Instruction const& inst = decoded.inst;
+	Decoded_Fields const& fields = decoded.fields;
+	Opcode_Encoding const& encoding = gOpcodeEncodings.entries[inst.type][static_cast<u8>(fields.layout)];
+	assertTrue(encoding.valid);
+	Encoder_Output output = {.items = out, .count = 0};
+
+	switch (fields.layout) {
+		case Decode_Layout::D_W_MOD_REG_RM: {
+			// (D = 1) REG is the destination.
+			Instruction_Operand const& reg = fields.D ? inst.dst : inst.src;
+			Instruction_Operand const& rm  = fields.D ? inst.src : inst.dst;
+			output.push08(encoding.byte | fields.D << 1 | fields.W);
+			output.pushModRM(fields.MOD, getRegisterEncoding(reg.reg), rm);
+		} break;
+
+		case Decode_Layout::W_MOD_RM: {
+			// A narrow immediate in a word instruction is only there because S was set.
+			bool const S = fields.W && !inst.src.immediate.wide;
+			output.push08(encoding.byte | S << 1 | fields.W);
+			output.pushModRM(fields.MOD, encoding.REG, inst.dst);
+			output.pushImmediate(inst.src.immediate);
+		} break;
+
+		case Decode_Layout::W_REG: {
+			output.push08(encoding.byte | fields.W << 3 | getRegisterEncoding(inst.dst.reg));
+			output.pushImmediate(inst.src.immediate);
+		} break;
+
+		case Decode_Layout::Accumulator: {
+			// (D = 1) The address is the destination.
+			Instruction_Operand const& address = fields.D ? inst.dst : inst.src;
+			output.push08(encoding.byte | fields.D << 1 | fields.W);
+			output.push16(address.address.displacement.word);
+		} break;
+
+		case Decode_Layout::D_MOD_SR_RM: {
+			// (D = 1) SR is the destination.
+			Instruction_Operand const& segment = fields.D ? inst.dst : inst.src;
+			Instruction_Operand const& rm      = fields.D ? inst.src : inst.dst;
+			output.push08(encoding.byte | fields.D << 1);
+			output.pushModRM(fields.MOD, getRegisterEncoding(segment.reg), rm);
+		} break;
+
+		case Decode_Layout::V_W_MOD_REG_RM: {
+			// lea is the only one whose REG is a register instead of part of the opcode.
+			bool const isLea = inst.type == Inst_lea;
+			Instruction_Operand const& rm = isLea ? inst.src : inst.dst;
+			u8 const REG = isLea ? getRegisterEncoding(inst.dst.reg) : encoding.REG;
+			// Every one of them has W in the first byte, even where the disassembly doesn't show it.
+			output.push08(encoding.byte | (fields.has_V ? fields.V << 1 : 0) | fields.W);
+			output.pushModRM(fields.MOD, REG, rm);
+		} break;
+
+		case Decode_Layout::W: {
+			output.push08(encoding.byte | fields.W);
+			output.pushImmediate(inst.src.immediate);
+		} break;
+
+		case Decode_Layout::Jump: {
+			output.push08(encoding.byte);
+			output.push08(cast(u8)inst.dst.jump_offset);
+		} break;
+
+		default: unreachable();
+	}
+	return output.count;
+}
+
+void encodeProgram(Instruction_Stream const& stream, std::vector<u8>& outBytes) {
+	for (Packed_Decoded_Instruction const& packed: stream.items) {
+		u8 bytes[MAX_BYTES_PER_INSTRUCTION_8086];
+		u8 const count = encodeInstruction(packed.unpack(), bytes);
+		outBytes.insert(outBytes.end(), bytes, bytes + count);
+	}
+}
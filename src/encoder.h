@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+
+#include "decoder.h"
+#include "instruction_stream.h"
+
+// Turns decoded instructions back into machine code. The operands give the
+// registers and values, the Decoded_Fields give the choices the original
+// bytes made (D, W, S, V and how wide the displacement was), so a program
+// that decoded correctly encodes back into exactly the same bytes.
+
+// The REG (or R/M) field that selects a register, the opposite of REG_Table and SR_Table.
+u8 getRegisterEncoding(RegisterInfo const& reg);
+// The R/M field of an effective address, the opposite of Effective_Address_Table.
+u8 getEffectiveAddressR_M(EffectiveAddress::Base base);
+
+// Writes at most MAX_BYTES_PER_INSTRUCTION_8086 bytes into out, returns how many.
+u8 encodeInstruction(Decoded_Instruction const& decoded, u8* out);
+void encodeProgram(Instruction_Stream const& stream, std::vector<u8>& outBytes);
@@ -0,0 +1,104 @@
+#include "file_bytes.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#if defined(_WIN32) || defined(_WIN64)
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#define FILE_READ_CHUNK_SIZE (64 * 1024)
+
+void File_Bytes::release() {
+	if (bytes.ptr != nullptr) {
+		if (mapped) {
+		#if defined(_WIN32) || defined(_WIN64)
+			UnmapViewOfFile(bytes.ptr);
+		#else
+			munmap(bytes.ptr, bytes.count);
+		#endif
+		} else {
+			free(bytes.ptr);
+		}
+	}
+	bytes = {};
+	mapped = false;
+}
+
+bool readStream(FILE* const file, File_Bytes& out) {
+	u8* buffer = nullptr;
+	size_t count = 0, capacity = 0;
+	for (;;) {
+		if (capacity - count < FILE_READ_CHUNK_SIZE) {
+			capacity = Max(2 * capacity, cast(size_t)FILE_READ_CHUNK_SIZE);
+			u8* const grown = static_cast<u8*>(realloc(buffer, capacity));
+			assertTrue(grown != nullptr);
+			buffer = grown;
+		}
+		size_t const n = fread(buffer + count, 1, capacity - count, file);
+		count += n;
+		if (n == 0) break;
+	}
+	if (ferror(file)) {
+		free(buffer);
+		return false;
+	}
+	out = {.bytes = PtrToSlice(buffer, count), .mapped = false};
+	return true;
+}
+
+// Maps the file if it's a regular one, mapped stays false if it isn't.
+static bool mapFile(const char* const path, File_Bytes& out, bool& mapped) {
+	mapped = false;
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE const file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		errno = ENOENT;
+		return false;
+	}
+	defer(CloseHandle(file));
+	LARGE_INTEGER size;
+	if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		return true;
+	}
+	HANDLE const mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) return true;
+	defer(CloseHandle(mapping));
+	void* const view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) return true;
+	out = {.bytes = Slice<u8>(static_cast<u8*>(view), cast(size_t)size.QuadPart), .mapped = true};
+#else
+	int const fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	defer(close(fd));
+	struct stat info;
+	if (fstat(fd, &info) != 0) return false;
+	if (!S_ISREG(info.st_mode) || info.st_size == 0) {
+		return true;
+	}
+	void* const view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED) return true;
+	madvise(view, info.st_size, MADV_SEQUENTIAL);
+	out = {.bytes = Slice<u8>(static_cast<u8*>(view), cast(size_t)info.st_size), .mapped = true};
+#endif
+	mapped = true;
+	return true;
+}
+
+bool loadFile(const char* const path, File_Bytes& out) {
+	bool mapped;
+	if (!mapFile(path, out, mapped)) return false;
+	if (mapped) return true;
+
+	// Empty, a pipe, or something mmap doesn't take.
+	FILE* const file = fopen(path, "rb");
+	if (file == nullptr) return false;
+	defer(fclose(file));
+	return readStream(file, out);
+}
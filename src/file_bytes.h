@@ -0,0 +1,19 @@
+#pragma once
+
+#include "util.h"
+
+// The contents of a file as a Slice<u8>. Regular files get mapped instead of
+// copied, so a big binary can be decoded right away and only the pages that
+// get touched are read. Pipes and other things that can't be mapped are read
+// in chunks until they end.
+struct File_Bytes {
+	Slice<u8> bytes;
+	bool mapped;  // Otherwise bytes.ptr came from malloc().
+
+	void release();
+};
+
+// Returns false with errno set if the file couldn't be opened or read.
+bool loadFile(const char* path, File_Bytes& out);
+// Reads what's left of an open file, for the ones that are already open.
+bool readStream(FILE* file, File_Bytes& out);
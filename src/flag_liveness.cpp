@@ -0,0 +1,64 @@
+#include "flag_liveness.h"
+
+enum struct Flag_Use : u8 { None, Read, Write };
+
+static Flag_Use getFlagUse(Instruction const& inst) {
+	switch (inst.type) {
+		case Inst_mov: case Inst_lea: case Inst_loop: case Inst_jcxz:
+			return Flag_Use::None;
+		case Inst_add: case Inst_sub: case Inst_cmp:
+			// Otherwise it does nothing but take its clocks.
+			return IsBinaryInstTypeOrderValid(inst) ? Flag_Use::Write : Flag_Use::None;
+		default:
+			return Flag_Use::Read;
+	}
+}
+
+// Goes backwards through the block from where the flags are live or not at its end.
+// deadAt: Where to mark the setters found dead on the way, if anywhere.
+static bool isLiveAtStart(Instruction_Stream const& stream, Basic_Block const& block, bool live, std::vector<bool>* const deadAt) {
+	for (u32 i = block.first + block.count; i-- > block.first;) {
+		Packed_Decoded_Instruction const& decoded = stream.items[i];
+		switch (getFlagUse(decoded.inst.unpack())) {
+			case Flag_Use::Read: live = true; break;
+			case Flag_Use::Write: {
+				if (!live && deadAt) (*deadAt)[decoded.offset] = true;
+				live = false;
+			} break;
+			default: break;
+		}
+	}
+	return live;
+}
+
+void analyzeFlagLiveness(Instruction_Stream const& stream, Control_Flow_Graph const& cfg, u32 const programSize, Flag_Liveness& liveness) {
+	size_t const count = cfg.blocks.size();
+	std::vector<bool> liveIn(count, false);
+	std::vector<bool> liveOut(count, false);
+
+	auto const getLiveOut = [&](Basic_Block const& block) {
+		bool live = block.leavesProgram;
+		if (block.taken != BLOCK_NONE) live = live || liveIn[block.taken];
+		if (block.next != BLOCK_NONE) live = live || liveIn[block.next];
+		return live;
+	};
+
+	// Backwards, since that's the way it flows, so most blocks settle in the first pass.
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (size_t b = count; b-- > 0;) {
+			Basic_Block const& block = cfg.blocks[b];
+			liveOut[b] = getLiveOut(block);
+			bool const live = isLiveAtStart(stream, block, liveOut[b], nullptr);
+			if (live != liveIn[b]) {
+				liveIn[b] = live;
+				changed = true;
+			}
+		}
+	}
+
+	liveness.deadAt.assign(programSize, false);
+	for (size_t b = 0; b < count; b++) {
+		isLiveAtStart(stream, cfg.blocks[b], liveOut[b], &liveness.deadAt);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include "control_flow.h"
+
+// Which add, sub and cmp set flags that nothing reads before another one sets
+// them again, so -run can leave Machine::pendingFlags alone for those.
+//
+// The flags count as read by the jumps that test them, which is all of them
+// but loop and jcxz, by whatever only the -exec path knows how to run, and by
+// the end of the program, where the final registers get printed. It's worked
+// out backwards over the basic blocks until nothing changes, a block's flags
+// being live at its end if they are at the start of a block it can go to.
+// A way out of the program that isn't a block, like a jump into the middle of
+// an instruction, counts as the end of the program.
+
+struct Flag_Liveness {
+	std::vector<bool> deadAt;  // By offset into the binary, true where such an add, sub or cmp starts.
+
+	[[nodiscard]] bool isDead(u32 const offset) const {
+		return offset < deadAt.size() && deadAt[offset];
+	}
+};
+
+void analyzeFlagLiveness(Instruction_Stream const& stream, Control_Flow_Graph const& cfg, u32 programSize, Flag_Liveness& liveness);
@@ -0,0 +1,328 @@
+#include <cinttypes>
+
+#include "formatter.h"
+#include "instruction_lengths.h"
+
+int Formatter::printInstText(Instruction const& inst) {
+	if (decorate) print(MNEMONIC_COLOR);
+	int n = _print("%s ", GetInstMnemonic(inst));
+	if (decorate) print(ASCII_COLOR_END);
+	n += printInstOperand(inst.dst, getInstDstPrefix(inst));
+	if (inst.src.type != Instruction_Operand_Type::None) {
+		n += _print(", ");
+		n += printInstOperand(inst.src, Instruction_Operand_Prefix::None);
+	}
+	return n;
+}
+
+void Formatter::printInst(Instruction const& inst) {
+	assertTrue(inst.dst.type != Instruction_Operand_Type::None);
+	int const n = printInstText(inst);
+	for (int i = 0; i < INSTRUCTION_LINE_SIZE-n; i++) {
+		fputc(' ', outFile);
+	}
+	if (decorate) print(COMMENT_COLOR);
+	print(" ;(%d) ", ++instructionCounter);
+}
+
+void Formatter::printBitsHeader() {
+	Instruction const bits = {
+		.dst = InstOpImmediate(false, 16),
+		.type = Inst_bits,
+	};
+	printInst(bits);
+	if (showClocks) {
+		explainClocks(outFile, getInstructionClocksCalculation(bits), Clock_Evaluation{}, 0);
+	}
+	fputc('\n', outFile);
+}
+
+void Formatter::printDecoded(Decoded_Instruction const& decoded, u8 const* bytes) {
+	printInst(decoded.inst);
+	printFields(decoded.fields, decoded.inst);
+	printBytes(bytes, decoded.size);
+}
+
+void Formatter::printExecuted(Decoded_Instruction const& decoded, Clock_Calculation const& clocks, Exec_Trace const& trace) {
+	printInst(decoded.inst);
+	if (showClocks) {
+		explainClocks(outFile, clocks, trace.clocks, trace.totalClocks);
+	}
+	printTrace(decoded.inst, trace);
+}
+
+void Formatter::printFields(Decoded_Fields const& fields, Instruction const& inst) const {
+	switch (fields.layout) {
+		case Decode_Layout::D_W_MOD_REG_RM: {
+			print("(D:%d, W:%d, ", fields.D, fields.W);
+			printMOD(fields.MOD, ' ');
+			printREG(fields.REG, ' ');
+			printR_M(fields.R_M, ')');
+			print(" <- ");
+		} break;
+
+		case Decode_Layout::W_MOD_RM: {
+			print("(W:%d, ", fields.W);
+			printMOD(fields.MOD, ' ');
+			printR_M(fields.R_M, ')');
+			print(" <- ");
+		} break;
+
+		case Decode_Layout::W_REG: {
+			print("(W:%d, ", fields.W);
+			printREG(fields.REG, ' ');
+			print(" <- ");
+		} break;
+
+		case Decode_Layout::Accumulator: {
+			// (D = 0) The address is the source.
+			const char* description = fields.D ? "Accumulator to memory" : "Memory to accumulator";
+			print("(%s, W:%d) <- ", description, fields.W);
+		} break;
+
+		case Decode_Layout::D_MOD_SR_RM: {
+			print("(D:%d, ", fields.D);
+			printMOD(fields.MOD, ' ');
+			printSR(fields.REG, ' ');
+			printR_M(fields.R_M, ')');
+			print(" <- ");
+		} break;
+
+		case Decode_Layout::V_W_MOD_REG_RM: {
+			print("(");
+			if (fields.has_V) print("V:%d ", fields.V);
+			if (fields.has_W) print("W:%d ", fields.W);
+			printMOD(fields.MOD, ' ');
+			printREG(fields.REG, ' ');
+			printR_M(fields.R_M, ' ');
+			print(") <- ");
+		} break;
+
+		case Decode_Layout::W: {
+			print("(W:%d) <- ", fields.W);
+		} break;
+
+		case Decode_Layout::Jump: {
+			print("(disp:%3d) <- ", inst.dst.jump_offset);
+		} break;
+
+		default: unreachable();
+	}
+}
+
+void Formatter::printBytes(u8 const* bytes, u8 const count) const {
+	for (u8 i = 0; i < count; i++) {
+		if (i > 0) fputc(' ', outFile);
+		printBits(outFile, bytes[i], 8);
+	}
+	if (decorate) print(ASCII_COLOR_END);
+	fputc('\n', outFile);
+}
+
+void Formatter::printFlagsChange(u16 const oldFlags, u16 const newFlags) const {
+	FlagsRegister::printSet(outFile, oldFlags);
+	print("->");
+	FlagsRegister::printSet(outFile, newFlags);
+}
+
+void Formatter::printTrace(Instruction const& inst, Exec_Trace const& trace) const {
+	switch (trace.kind) {
+		case Exec_Trace_Kind::Write: {
+			if (IsOperandMem(inst.dst)) {
+				print("[%" PRIu32 "]", trace.dstAddress);
+			} else {
+				print("%s", getRegisterName(inst.dst.reg));
+			}
+			print(":0x%x->0x%x ", trace.oldValue, trace.newValue);
+			print("ip:0x%x->0x%x", trace.oldIP, trace.newIP);
+			if (trace.setsFlags) {
+				print(" flags:");
+				printFlagsChange(FlagsRegister::get(trace.oldFlags), FlagsRegister::get(trace.newFlags));
+			}
+		} break;
+
+		case Exec_Trace_Kind::Jump: {
+			if (trace.outcome == Jumps::Outcome::error) {
+				println(LOG_ERROR_STRING ": %s is unimplemented", GetInstMnemonic(inst));
+				return;
+			}
+			print("%s ", GetJumpOutcomeName(trace.outcome));
+			if (JumpModifiesCX(inst.type)) {
+				print("cx:%d->%d ", trace.oldCX, trace.newCX);
+			}
+			print("ip:0x%x->0x%x", trace.oldIP, trace.newIP);
+		} break;
+
+		case Exec_Trace_Kind::InvalidOperands: {
+			println(ErrorComment_InvalidInstructionTypeOrder(inst));
+		} return;
+
+		default: unreachable();
+	}
+	fputc('\n', outFile);
+	if (decorate) print(ASCII_COLOR_END);
+}
+
+void Formatter::printRegistersLN(Machine& machine) const {
+	FlagsRegister::materialize(machine);
+	for (size_t i = 0; i < RegisterCount; i++) {
+		RegisterInfo const reg = RegisterList[i];
+		const char* name = RegisterNames[i];
+		u16 const value = getRegisterValue(machine, reg);
+		if (value == 0) continue;
+		if (reg.type == Register::fl) {
+			print("%8s: ", "flags");
+			FlagsRegister::printSet(outFile, value);
+			fputc('\n', outFile);
+		} else {
+			println("%8s: 0x%04x (%d)", name, value, value);
+		}
+	}
+}
+
+void Formatter::printSimulationStats(Simulation_Stats const& stats) const {
+	f64 const perSecond = (stats.seconds > 0) ? stats.instructions / stats.seconds : 0;
+	println("Instructions: %" PRIu64, stats.instructions);
+	println("Clocks: %" PRIu64, stats.clocks);
+	println("Time: %g s (%.2f M instructions/s)", stats.seconds, perSecond / 1e6);
+}
+
+void Formatter::printUnrecognizedByte(u8 const byte) const {
+	eprintf(LOG_ERROR_STRING": Had an unrecognized byte (" ASCII_COLOR_B_RED);
+	printBits(stderr, byte, 8);
+	eprintfln(ASCII_COLOR_END")");
+}
+
+void Formatter::printDecodeFailure(Slice<u8> const& bytes, size_t const offset) const {
+	if (isTruncatedAt(bytes, offset)) {
+		eprintfln(LOG_ERROR_STRING": The instruction at byte %zu is cut off by the end of the program.", offset);
+	} else {
+		printUnrecognizedByte(bytes.ptr[offset]);
+	}
+}
+
+int Formatter::printEffectiveAddressBase(EffectiveAddress::Base const base) const {
+	using namespace EffectiveAddress;
+	int constexpr BASE_INDEX_LEN = sizeof("?? + ??")-1;
+
+	if (decorate) {
+		switch (base) {
+			case Base::Direct: return 0;
+			#define X(R) REGISTER_COLOR R ASCII_COLOR_END
+			case Base::bx_si: print(X("bx") " + " X("si")); return BASE_INDEX_LEN;
+			case Base::bx_di: print(X("bx") " + " X("di")); return BASE_INDEX_LEN;
+			case Base::bp_si: print(X("bp") " + " X("si")); return BASE_INDEX_LEN;
+			case Base::bp_di: print(X("bp") " + " X("di")); return BASE_INDEX_LEN;
+			#undef X
+
+			case Base::si: case Base::di: case Base::bp: case Base::bx: {
+				print(REGISTER_COLOR);
+				int const n = _print(base2string(base));
+				print(ASCII_COLOR_END);
+				return n;
+			}
+
+			default: return 0;
+		}
+	}
+	return _print(base2string(base));
+}
+
+int Formatter::printInstOperand(Instruction_Operand const& operand, Instruction_Operand_Prefix prefix) const {
+	if (operand.type == Instruction_Operand_Type::None) return 0;
+	int n = 0;
+
+	switch (prefix) {
+        case Instruction_Operand_Prefix::Byte:
+        case Instruction_Operand_Prefix::Word:
+			if (decorate) print(INST_PREFIX_COLOR);
+			n+=_print("%s ", InstOpPrefixName[static_cast<u8>(prefix)]);
+			if (decorate) print(ASCII_COLOR_END);
+			break;
+		default: break;
+	}
+
+	switch (operand.type) {
+        case Instruction_Operand_Type::Immediate: {
+        	if (decorate) print(NUMBER_COLOR);
+        	if (operand.immediate.wide) {
+        		n+=_print("%" PRIi16, operand.immediate.word);
+        	} else {
+        		n+=_print("%" PRIi8, operand.immediate.byte);
+        	}
+        	if (decorate) print(ASCII_COLOR_END);
+        } break;
+
+        case Instruction_Operand_Type::Register: {
+        	if (decorate) print(REGISTER_COLOR);
+			n+=_print(getRegisterName(operand.reg));
+        	if (decorate) print(ASCII_COLOR_END);
+        } break;
+
+        case Instruction_Operand_Type::EffectiveAddress: {
+			fputc('[', outFile); n++;
+        	bool const hasBase = operand.address.base != EffectiveAddress::Base::Direct;
+        	if (hasBase) {
+        		n += printEffectiveAddressBase(operand.address.base);
+        	}
+        	if (operand.address.displacement.wide) {
+                if (operand.address.displacement.word > 0) {
+					if (hasBase) n+=_print(" + ");
+					if (decorate) print(NUMBER_COLOR);
+					n+=_print("%" PRIi16, operand.address.displacement.word);
+					if (decorate) print(ASCII_COLOR_END);
+                } else if (operand.address.displacement.word < 0) {
+					n+=_print(hasBase ? " - " : "-");
+					if (decorate) print(NUMBER_COLOR);
+					n+=_print("%" PRIi16, -operand.address.displacement.word);
+					if (decorate) print(ASCII_COLOR_END);
+                }
+        	} else {
+                if (operand.address.displacement.byte > 0) {
+					if (hasBase) n+=_print(" + ");
+					if (decorate) print(NUMBER_COLOR);
+					n+=_print("%" PRIi8, operand.address.displacement.byte);
+					if (decorate) print(ASCII_COLOR_END);
+                } else if (operand.address.displacement.byte < 0) {
+					n+=_print(hasBase ? " - " : "-");
+					if (decorate) print(NUMBER_COLOR);
+					n+=_print("%" PRIi16, -operand.address.displacement.byte);
+					if (decorate) print(ASCII_COLOR_END);
+                }
+        	}
+			fputc(']', outFile); n++;
+        } break;
+
+		case Instruction_Operand_Type::Jump: {
+			// The offset gets added 2 because the jump instructions take up 2 bytes.
+			i8 const disp = static_cast<i8>(operand.jump_offset + 2);
+			if (disp > 0) {
+				n+=_print("$+");
+				if (decorate) print(NUMBER_COLOR);
+				n+=_print("%" PRIi8, disp);
+				if (decorate) print(ASCII_COLOR_END);
+				n+=_print("+");
+				if (decorate) print(NUMBER_COLOR);
+				n+=_print("%" PRIi8, 0);
+				if (decorate) print(ASCII_COLOR_END);
+			} else if (disp < 0) {
+				n+=_print("$-");
+				if (decorate) print(NUMBER_COLOR);
+				n+=_print("%" PRIi8, -disp);
+				if (decorate) print(ASCII_COLOR_END);
+				n+=_print("+");
+				if (decorate) print(NUMBER_COLOR);
+				n+=_print("%" PRIi8, 0);
+				if (decorate) print(ASCII_COLOR_END);
+			} else {
+				n+=_print("$+");
+				if (decorate) print(NUMBER_COLOR);
+				n+=_print("%" PRIi8, 0);
+				if (decorate) print(ASCII_COLOR_END);
+			}
+		} break;
+
+        default: unreachable();
+	}
+	return n;
+}
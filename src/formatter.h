@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdarg>
+
+#include "decoder.h"
+#include "instruction_stream.h"
+
+// Turns decoded instructions and execution traces into text. Nothing here
+// decodes or executes, it only reads what the other stages recorded.
+struct Formatter {
+	FILE* const outFile;
+	u64 instructionCounter = 0;
+	bool const showClocks;
+	bool const decorate;
+
+	explicit Formatter(FILE* OutFile, bool const ShowClocks):
+		outFile(OutFile), showClocks(ShowClocks), decorate(isatty(fileno(OutFile))) {}
+	explicit Formatter(FILE* OutFile, bool const ShowClocks, bool const Decorate):
+		outFile(OutFile), showClocks(ShowClocks), decorate(Decorate) {}
+
+	void printBitsHeader();
+	void printDecoded(Decoded_Instruction const& decoded, u8 const* bytes);
+	void printExecuted(Decoded_Instruction const& decoded, Clock_Calculation const& clocks, Exec_Trace const& trace);
+	void printRegistersLN(Machine& machine) const;
+	void printSimulationStats(Simulation_Stats const& stats) const;
+	void printUnrecognizedByte(u8 byte) const;
+	// For where decodeNext() failed, either of the two reasons it can.
+	void printDecodeFailure(Slice<u8> const& bytes, size_t offset) const;
+	// Just the assembly, without the padding and the comment printDecoded() adds. Returns its length.
+	int printInstText(Instruction const& inst);
+
+	void print(const char* fmt, ...) const {
+		va_list args;
+		va_start(args, fmt);
+		vfprintf(outFile, fmt, args);
+		va_end(args);
+	}
+
+	int _print(const char* fmt, ...) const {
+		va_list args;
+		va_start(args, fmt);
+		int const n = vfprintf(outFile, fmt, args);
+		va_end(args);
+		return n;
+	}
+
+	void println(const char* fmt, ...) const {
+		va_list args;
+		va_start(args, fmt);
+		vfprintf(outFile, fmt, args);
+		fputc('\n', outFile);
+		va_end(args);
+	}
+
+private:
+	void printInst(Instruction const& inst);
+	void printFields(Decoded_Fields const& fields, Instruction const& inst) const;
+	void printBytes(u8 const* bytes, u8 count) const;
+	void printTrace(Instruction const& inst, Exec_Trace const& trace) const;
+	void printFlagsChange(u16 oldFlags, u16 newFlags) const;
+	[[nodiscard]] int printEffectiveAddressBase(EffectiveAddress::Base base) const;
+	[[nodiscard]] int printInstOperand(Instruction_Operand const& operand, Instruction_Operand_Prefix prefix) const;
+
+	void printSR(u8 const SR, char const ending) const {
+		fprintf(outFile, "SR:");
+		printBits(outFile, SR, 2, ending);
+	}
+
+	void printMOD(u8 const MOD, char const ending) const {
+		fprintf(outFile, "MOD:");
+		printBits(outFile, MOD, 2, ending);
+	}
+
+	void printREG(u8 const REG, char const ending) const {
+		fprintf(outFile, "REG:");
+		printBits(outFile, REG, 3, ending);
+	}
+
+	void printR_M(u8 const R_M, char const ending) const {
+		fprintf(outFile, "R/M:");
+		printBits(outFile, R_M, 3, ending);
+	}
+};
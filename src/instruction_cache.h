@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "decoder.h"
+#include "opcode_table.h"
+#include "instruction_stream.h"
+
+// What -exec needs to run an instruction again without touching its bytes.
+struct Cached_Instruction {
+	Packed_Decoded_Instruction decoded; // decoded.size is 0 while this IP hasn't been decoded yet.
+	Clock_Calculation clocks;
+	Exec_Proc exec;
+};
+
+// Expects to be indexed by IP, one slot per byte of the program since any of
+// them can be jumped to. The bytes are in Machine::memory, but nothing here
+// notices the program writing over them, the old instruction keeps running.
+struct Instruction_Cache {
+	std::vector<Cached_Instruction> entries;
+
+	explicit Instruction_Cache(size_t const ByteCount): entries(ByteCount) {}
+
+	[[nodiscard]] Cached_Instruction const* find(u16 const ip) const {
+		if (ip >= entries.size()) return nullptr;
+		Cached_Instruction const& entry = entries[ip];
+		return (entry.decoded.size > 0) ? &entry : nullptr;
+	}
+
+	Cached_Instruction const& insert(u16 const ip, Decoded_Instruction const& decoded, Exec_Proc const exec) {
+		assertTrue(ip < entries.size());
+		assertTrue(decoded.size > 0);
+		Cached_Instruction& entry = entries[ip];
+		entry = {
+			.decoded = Packed_Decoded_Instruction::pack(decoded),
+			.clocks = getInstructionClocksCalculation(decoded.inst),
+			.exec = exec,
+		};
+		return entry;
+	}
+};
@@ -0,0 +1,166 @@
+#include "instruction_lengths.h"
+
+#include "opcode_table.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#include <immintrin.h>
+	#define INSTRUCTION_LENGTHS_SIMD 1
+#else
+	#define INSTRUCTION_LENGTHS_SIMD 0
+#endif
+
+// How many lengths get worked out before following them.
+#define INSTRUCTION_LENGTHS_BLOCK_SIZE 4096
+
+// Expects to be indexed as [MOD | (R/M == 110) << 2], same as get_Disp_Type().
+constexpr u8 Disp_Length_Table[16] = {0, 1, 2, 0, 2, 1, 2, 0};
+
+force_inline inline u8 getDispLength(u8 const modrm) {
+	return Disp_Length_Table[(modrm >> 6) | (((modrm & 0b111) == 0b110) << 2)];
+}
+
+// The byte after the last one reads as 0, like lookupOpcode() treats it.
+u8 getInstructionLength(Slice<u8> const& binaryBytes, size_t const i) {
+	u8 const byte = binaryBytes.ptr[i];
+	u8 const modrm = (i + 1 < binaryBytes.count) ? binaryBytes.ptr[i + 1] : 0;
+	u8 entry = gOpcodeLengths.primary[byte];
+	if (entry & OPCODE_LENGTH_EXTENDED) {
+		entry = gOpcodeLengths.extended[byte][(modrm >> 3) & 0b111];
+	}
+	u8 const base = entry & OPCODE_LENGTH_BASE_MASK;
+	if (base == 0) return 0;
+	return base + ((entry & OPCODE_LENGTH_MODRM) ? getDispLength(modrm) : 0);
+}
+
+static void getLengthsScalar(Slice<u8> const& binaryBytes, size_t const from, size_t const to, u8* const out) {
+	for (size_t i = from; i < to; i++) {
+		out[i - from] = getInstructionLength(binaryBytes, i);
+	}
+}
+
+#if INSTRUCTION_LENGTHS_SIMD
+// gOpcodeLengths.primary is looked up 16 entries at a time, one shuffle per
+// high nibble of the opcode, keeping the lanes whose high nibble it was.
+// The group opcodes are marked in the result and redone one by one.
+__attribute__((target("ssse3")))
+static void getLengthsSSSE3(Slice<u8> const& binaryBytes, size_t const from, size_t const to, u8* const out) {
+	__m128i const lowNibble = _mm_set1_epi8(0x0F);
+	__m128i const dispTable = _mm_loadu_si128(cast(__m128i const*)Disp_Length_Table);
+	__m128i rows[16];
+	for (int h = 0; h < 16; h++) {
+		rows[h] = _mm_loadu_si128(cast(__m128i const*)(gOpcodeLengths.primary + 16 * h));
+	}
+
+	size_t i = from;
+	for (; i + 16 <= to && i + 17 <= binaryBytes.count; i += 16) {
+		__m128i const opcode = _mm_loadu_si128(cast(__m128i const*)(binaryBytes.ptr + i));
+		__m128i const modrm  = _mm_loadu_si128(cast(__m128i const*)(binaryBytes.ptr + i + 1));
+
+		__m128i const lo = _mm_and_si128(opcode, lowNibble);
+		__m128i const hi = _mm_and_si128(_mm_srli_epi16(opcode, 4), lowNibble);
+		__m128i entry = _mm_setzero_si128();
+		for (int h = 0; h < 16; h++) {
+			__m128i const isRow = _mm_cmpeq_epi8(hi, _mm_set1_epi8(cast(char)h));
+			entry = _mm_or_si128(entry, _mm_and_si128(isRow, _mm_shuffle_epi8(rows[h], lo)));
+		}
+
+		__m128i const MOD = _mm_and_si128(_mm_srli_epi16(modrm, 6), _mm_set1_epi8(0b11));
+		__m128i const isDirect = _mm_cmpeq_epi8(_mm_and_si128(modrm, _mm_set1_epi8(0b111)), _mm_set1_epi8(0b110));
+		__m128i const disp = _mm_shuffle_epi8(dispTable, _mm_or_si128(MOD, _mm_and_si128(isDirect, _mm_set1_epi8(4))));
+
+		__m128i const base = _mm_and_si128(entry, _mm_set1_epi8(OPCODE_LENGTH_BASE_MASK));
+		__m128i const hasModRM = _mm_cmpeq_epi8(_mm_and_si128(entry, _mm_set1_epi8(OPCODE_LENGTH_MODRM)), _mm_set1_epi8(OPCODE_LENGTH_MODRM));
+		__m128i const isValid = _mm_xor_si128(_mm_cmpeq_epi8(base, _mm_setzero_si128()), _mm_set1_epi8(-1));
+		__m128i const length = _mm_and_si128(isValid, _mm_add_epi8(base, _mm_and_si128(hasModRM, disp)));
+		_mm_storeu_si128(cast(__m128i*)(out + (i - from)), length);
+
+		u32 extended = _mm_movemask_epi8(_mm_slli_epi16(entry, 3)); // OPCODE_LENGTH_EXTENDED into the sign bit.
+		for (; extended != 0; extended &= extended - 1) {
+			u32 const lane = __builtin_ctz(extended);
+			out[i - from + lane] = getInstructionLength(binaryBytes, i + lane);
+		}
+	}
+	getLengthsScalar(binaryBytes, i, to, out + (i - from));
+}
+
+// Same as the SSSE3 one, 32 at a time. The shuffles only look within each
+// 128-bit half, so the tables are in both halves.
+__attribute__((target("avx2")))
+static void getLengthsAVX2(Slice<u8> const& binaryBytes, size_t const from, size_t const to, u8* const out) {
+	__m256i const lowNibble = _mm256_set1_epi8(0x0F);
+	__m256i const dispTable = _mm256_broadcastsi128_si256(_mm_loadu_si128(cast(__m128i const*)Disp_Length_Table));
+	__m256i rows[16];
+	for (int h = 0; h < 16; h++) {
+		rows[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128(cast(__m128i const*)(gOpcodeLengths.primary + 16 * h)));
+	}
+
+	size_t i = from;
+	for (; i + 32 <= to && i + 33 <= binaryBytes.count; i += 32) {
+		__m256i const opcode = _mm256_loadu_si256(cast(__m256i const*)(binaryBytes.ptr + i));
+		__m256i const modrm  = _mm256_loadu_si256(cast(__m256i const*)(binaryBytes.ptr + i + 1));
+
+		__m256i const lo = _mm256_and_si256(opcode, lowNibble);
+		__m256i const hi = _mm256_and_si256(_mm256_srli_epi16(opcode, 4), lowNibble);
+		__m256i entry = _mm256_setzero_si256();
+		for (int h = 0; h < 16; h++) {
+			__m256i const isRow = _mm256_cmpeq_epi8(hi, _mm256_set1_epi8(cast(char)h));
+			entry = _mm256_or_si256(entry, _mm256_and_si256(isRow, _mm256_shuffle_epi8(rows[h], lo)));
+		}
+
+		__m256i const MOD = _mm256_and_si256(_mm256_srli_epi16(modrm, 6), _mm256_set1_epi8(0b11));
+		__m256i const isDirect = _mm256_cmpeq_epi8(_mm256_and_si256(modrm, _mm256_set1_epi8(0b111)), _mm256_set1_epi8(0b110));
+		__m256i const disp = _mm256_shuffle_epi8(dispTable, _mm256_or_si256(MOD, _mm256_and_si256(isDirect, _mm256_set1_epi8(4))));
+
+		__m256i const base = _mm256_and_si256(entry, _mm256_set1_epi8(OPCODE_LENGTH_BASE_MASK));
+		__m256i const hasModRM = _mm256_cmpeq_epi8(_mm256_and_si256(entry, _mm256_set1_epi8(OPCODE_LENGTH_MODRM)), _mm256_set1_epi8(OPCODE_LENGTH_MODRM));
+		__m256i const isValid = _mm256_xor_si256(_mm256_cmpeq_epi8(base, _mm256_setzero_si256()), _mm256_set1_epi8(-1));
+		__m256i const length = _mm256_and_si256(isValid, _mm256_add_epi8(base, _mm256_and_si256(hasModRM, disp)));
+		_mm256_storeu_si256(cast(__m256i*)(out + (i - from)), length);
+
+		u32 extended = _mm256_movemask_epi8(_mm256_slli_epi16(entry, 3));
+		for (; extended != 0; extended &= extended - 1) {
+			u32 const lane = __builtin_ctz(extended);
+			out[i - from + lane] = getInstructionLength(binaryBytes, i + lane);
+		}
+	}
+	getLengthsScalar(binaryBytes, i, to, out + (i - from));
+}
+#endif
+
+typedef void (*Get_Lengths_Proc)(Slice<u8> const& binaryBytes, size_t from, size_t to, u8* out);
+
+static Get_Lengths_Proc pickGetLengths() {
+#if INSTRUCTION_LENGTHS_SIMD
+	if (__builtin_cpu_supports("avx2"))  return getLengthsAVX2;
+	if (__builtin_cpu_supports("ssse3")) return getLengthsSSSE3;
+#endif
+	return getLengthsScalar;
+}
+
+bool findInstructionOffsets(Slice<u8> const binaryBytes, Instruction_Offsets& offsets) {
+	static Get_Lengths_Proc const getLengths = pickGetLengths();
+	u8 lengths[INSTRUCTION_LENGTHS_BLOCK_SIZE];
+
+	// Each block starts where the instruction after the last block starts, so
+	// an instruction never has its length in a block it doesn't start in.
+	size_t at = 0;
+	while (at < binaryBytes.count) {
+		size_t const blockEnd = Min(at + INSTRUCTION_LENGTHS_BLOCK_SIZE, binaryBytes.count);
+		getLengths(binaryBytes, at, blockEnd, lengths);
+		size_t const blockStart = at;
+		while (at < blockEnd) {
+			u8 const length = lengths[at - blockStart];
+			if (length == 0) {
+				offsets.unrecognizedOffset = at;
+				return false;
+			}
+			offsets.items.push_back(at);
+			if (at + length > binaryBytes.count) {
+				offsets.truncated = true;
+				return false;
+			}
+			at += length;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include "decoder.h"
+
+// Finds where every instruction starts without decoding them, so whatever
+// only needs the boundaries (splitting a binary up, finding blocks, jumping
+// to the nth instruction) doesn't pay for building the operands.
+//
+// The length an instruction would have is worked out for every byte at once,
+// 16 or 32 of them at a time with SSSE3 or AVX2 when the CPU has them, from
+// gOpcodeLengths and the ModRM byte after it. Then the lengths are followed
+// from the start, which is all that has to go one instruction at a time.
+
+struct Instruction_Offsets {
+	std::vector<u32> items;        // Where each instruction starts, in order.
+	i64 unrecognizedOffset = -1;   // Same as in Instruction_Stream.
+	bool truncated = false;        // The last instruction goes past the end of the binary.
+};
+
+// Stops where decodeProgram() stops, and returns false in the same cases.
+bool findInstructionOffsets(Slice<u8> binaryBytes, Instruction_Offsets& offsets);
+
+// The length of the instruction at offset, 0 if its first byte isn't recognized.
+// It can go past the end of binaryBytes.
+u8 getInstructionLength(Slice<u8> const& binaryBytes, size_t offset);
+
+// When decodeNext() fails there, tells a cut off instruction from an unrecognized byte.
+force_inline inline bool isTruncatedAt(Slice<u8> const& binaryBytes, size_t const offset) {
+	return offset + getInstructionLength(binaryBytes, offset) > binaryBytes.count;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <vector>
+
+#include "decoder.h"
+#include "packed_instruction.h"
+
+// Which encoding fields the disassembly shows next to an instruction.
+enum struct Decode_Layout : u8 {
+	D_W_MOD_REG_RM,  // (D:1, W:1, MOD:11 REG:000 R/M:001)
+	W_MOD_RM,        // (W:1, MOD:11 R/M:000)
+	W_REG,           // (W:1, REG:000
+	Accumulator,     // (Memory to accumulator, W:1)
+	D_MOD_SR_RM,     // (D:1, MOD:11 SR:00 R/M:000)
+	V_W_MOD_REG_RM,  // (V:0 W:1 MOD:11 REG:100 R/M:000 )
+	W,               // (W:1)
+	Jump,            // (disp: -2)
+	Count,
+};
+
+struct Decoded_Fields {
+	Decode_Layout layout;
+	u8 MOD     : 2;
+	u8 REG     : 3; // Holds SR for Decode_Layout::D_MOD_SR_RM.
+	u8 R_M     : 3;
+	bool D     : 1;
+	bool W     : 1;
+	bool V     : 1;
+	bool has_V : 1;
+	bool has_W : 1;
+};
+
+struct Decoded_Instruction {
+	Instruction inst;
+	Decoded_Fields fields;
+	u32 offset;
+	u8 size;
+};
+
+static_assert(static_cast<u8>(Decode_Layout::Count) <= 8);
+
+struct Packed_Decoded_Instruction {
+	Packed_Instruction inst;
+	u32 offset;
+	u16 fields;
+	u8 size;
+
+	static Packed_Decoded_Instruction pack(Decoded_Instruction const& decoded) {
+		Decoded_Fields const& f = decoded.fields;
+		u16 const fields = static_cast<u16>(f.layout) | (f.MOD << 3) | (f.REG << 5) | (f.R_M << 8) |
+		                   (f.D << 11) | (f.W << 12) | (f.V << 13) | (f.has_V << 14) | (f.has_W << 15);
+		return Packed_Decoded_Instruction{
+			.inst = Packed_Instruction::pack(decoded.inst),
+			.offset = decoded.offset,
+			.fields = fields,
+			.size = decoded.size,
+		};
+	}
+
+	[[nodiscard]] Decoded_Fields unpackFields() const {
+		return Decoded_Fields{
+			.layout = static_cast<Decode_Layout>(fields & 0b111),
+			.MOD = cast(u8)((fields >> 3) & 0b11),
+			.REG = cast(u8)((fields >> 5) & 0b111),
+			.R_M = cast(u8)((fields >> 8) & 0b111),
+			.D = cast(bool)((fields >> 11) & 1),
+			.W = cast(bool)((fields >> 12) & 1),
+			.V = cast(bool)((fields >> 13) & 1),
+			.has_V = cast(bool)((fields >> 14) & 1),
+			.has_W = cast(bool)((fields >> 15) & 1),
+		};
+	}
+
+	[[nodiscard]] Decoded_Instruction unpack() const {
+		return Decoded_Instruction{
+			.inst = inst.unpack(),
+			.fields = unpackFields(),
+			.offset = offset,
+			.size = size,
+		};
+	}
+};
+static_assert(sizeof(Packed_Decoded_Instruction) == 16);
+
+struct Instruction_Stream {
+	std::vector<Packed_Decoded_Instruction> items;
+	i64 unrecognizedOffset = -1; // Where decoding stopped, if it didn't reach the end.
+	bool truncated = false;      // Because the instruction there goes past the end, not an unrecognized byte.
+
+	void push(Decoded_Instruction const& decoded) {
+		items.push_back(Packed_Decoded_Instruction::pack(decoded));
+	}
+
+	[[nodiscard]] Decoded_Instruction get(size_t const i) const {
+		return items[i].unpack();
+	}
+};
+
+// Decodes the whole binary without printing anything.
+bool decodeProgram(Slice<u8> binaryBytes, Instruction_Stream& stream);
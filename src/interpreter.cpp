@@ -0,0 +1,522 @@
+#include "interpreter.h"
+
+#include <chrono>
+
+#include "flag_liveness.h"
+#include "jit.h"
+#include "jumps.h"
+
+#define IP_VALUE(machine) (machine).registers.words[RegToID(Register::ip)]
+#define CX_VALUE(machine) (machine).registers.words[RegToID(Register::c)]
+
+Operand_Kind getOperandKind(Instruction_Operand const& operand) {
+	switch (operand.type) {
+		case Instruction_Operand_Type::Register:
+			return (operand.reg.usage == RegisterUsage::x) ? Operand_Kind::Reg16 : Operand_Kind::Reg8;
+		case Instruction_Operand_Type::EffectiveAddress:
+			return operand.address.wide ? Operand_Kind::Mem16 : Operand_Kind::Mem8;
+		case Instruction_Operand_Type::Immediate:
+			return Operand_Kind::Imm;
+		default:
+			return Operand_Kind::None;
+	}
+}
+
+static Operand_Slot lowerOperand(Instruction_Operand const& operand) {
+	Operand_Slot slot = {};
+	switch (operand.type) {
+		case Instruction_Operand_Type::Register: {
+			slot.reg = getRegisterOffset(operand.reg);
+		} break;
+
+		case Instruction_Operand_Type::EffectiveAddress: {
+			Immediate const& disp = operand.address.displacement;
+			slot.displacement = cast(u32)(disp.wide ? disp.word : disp.byte);
+		} break;
+
+		case Instruction_Operand_Type::Immediate: {
+			// Sign extended the same way getInstOpValue() does it.
+			slot.immediate = operand.immediate.wide ? operand.immediate.word : operand.immediate.byte;
+		} break;
+
+		default: break;
+	}
+	return slot;
+}
+
+// Same sum as EffectiveAddress::getInnerValue(), wrapping included.
+template <EffectiveAddress::Base base>
+force_inline static inline u32 getAddress(Machine const& machine, u32 const displacement) {
+	using Base = EffectiveAddress::Base;
+	#define R(r) cast(u32)machine.registers.words[RegToID(Register::r)]
+	switch (base) {
+		case Base::bx_si:  return R(b)  + R(si) + displacement;
+		case Base::bx_di:  return R(b)  + R(di) + displacement;
+		case Base::bp_si:  return R(bp) + R(si) + displacement;
+		case Base::bp_di:  return R(bp) + R(di) + displacement;
+		case Base::si:     return R(si) + displacement;
+		case Base::di:     return R(di) + displacement;
+		case Base::bp:     return R(bp) + displacement;
+		case Base::bx:     return R(b)  + displacement;
+		case Base::Direct: return displacement;
+	}
+	#undef R
+	unreachable();
+}
+
+// address: Where the memory operand points, if the instruction has one.
+template <Operand_Kind kind>
+force_inline static inline u32 readSlot(Machine const& machine, Operand_Slot const& slot, u32 const address) {
+	if constexpr (kind == Operand_Kind::Reg8)  return machine.registers.bytes[slot.reg];
+	if constexpr (kind == Operand_Kind::Reg16) return machine.registers.words[slot.reg / 2];
+	if constexpr (kind == Operand_Kind::Imm)   return slot.immediate;
+	if constexpr (kind == Operand_Kind::Mem8) {
+		StaticArrayBoundsCheck(address, machine.memory);
+		return machine.memory[address];
+	}
+	if constexpr (kind == Operand_Kind::Mem16) {
+		// address+1 alone would wrap around to 0 for an address of 0xFFFFFFFF.
+		StaticArrayBoundsCheck(address, machine.memory);
+		StaticArrayBoundsCheck(address+1, machine.memory);
+		return (machine.memory[address+1] << 8) + machine.memory[address+0];
+	}
+	unreachable();
+}
+
+template <Operand_Kind kind>
+force_inline static inline void writeSlot(Machine& machine, Operand_Slot const& slot, u32 const address, u32 const value) {
+	if constexpr (kind == Operand_Kind::Reg8) {
+		machine.registers.bytes[slot.reg] = cast(u8)value;
+	} else if constexpr (kind == Operand_Kind::Reg16) {
+		machine.registers.words[slot.reg / 2] = cast(u16)value;
+	} else if constexpr (kind == Operand_Kind::Mem8) {
+		StaticArrayBoundsCheck(address, machine.memory);
+		machine.memory[address] = value;
+	} else if constexpr (kind == Operand_Kind::Mem16) {
+		StaticArrayBoundsCheck(address, machine.memory);
+		StaticArrayBoundsCheck(address+1, machine.memory);
+		machine.memory[address+0] = value & 0xFF;
+		machine.memory[address+1] = (value >> 8) & 0xFF;
+	} else {
+		unreachable();
+	}
+}
+
+// Every handler starts with this: the clocks are counted with the registers
+// as they were before the instruction, and the IP already points past it.
+// address: The memory operand's, only looked at when there are transfers.
+force_inline static inline void begin(Interpreter& interpreter, Lowered_Op const* op, u32 const address = 0) {
+	Machine& machine = interpreter.machine;
+	machine.clocks += op->clocks;
+	if (op->transfers > 0 && address % 2 == 1) {
+		machine.clocks += 4 * op->transfers;
+	}
+	IP_VALUE(machine) = op->nextIP;
+	interpreter.instructions++;
+}
+
+static Lowered_Op const* op_halt(Interpreter& interpreter, Lowered_Op const* op) {
+	Unused(interpreter); Unused(op);
+	return nullptr;
+}
+
+static Lowered_Op const* op_lower(Interpreter& interpreter, Lowered_Op const* op) {
+	Lowered_Op& self = interpreter.ops[op - interpreter.ops.data()];
+	interpreter.lowerOp(self);
+	return self.handler(interpreter, op);
+}
+
+static Lowered_Op const* op_unrecognized(Interpreter& interpreter, Lowered_Op const* op) {
+	interpreter.unrecognizedOffset = op->ip;
+	return nullptr;
+}
+
+// Runs the compiled block, and goes back to the handler it replaced when the
+// block couldn't get past its first instruction (a memory operand out of bounds).
+static Lowered_Op const* op_jitted(Interpreter& interpreter, Lowered_Op const* op) {
+	i64 const stoppedAt = op->jitted(&interpreter.machine, &interpreter.instructions);
+	if (stoppedAt == op->ip) {
+		return op->interpreted(interpreter, op);
+	}
+	// Where it went counts as a hit, the jumps inside the block didn't get to count theirs.
+	Lowered_Op const* next = interpreter.opAt(stoppedAt);
+	interpreter.countHit(next);
+	return next;
+}
+
+static Lowered_Op const* op_nop(Interpreter& interpreter, Lowered_Op const* op) {
+	begin(interpreter, op);
+	return op->next;
+}
+
+// mov and the execOp() family, for one combination of operands.
+// flagsLive: Whether anything reads the flags an add, sub or cmp sets, see flag_liveness.h.
+template <Instruction_Type type, Operand_Kind dst, Operand_Kind src, EffectiveAddress::Base base, bool flagsLive>
+static Lowered_Op const* op_binary(Interpreter& interpreter, Lowered_Op const* op) {
+	Machine& machine = interpreter.machine;
+	u32 address = 0;
+	if constexpr (isMem(dst)) address = getAddress<base>(machine, op->dst.displacement);
+	if constexpr (isMem(src)) address = getAddress<base>(machine, op->src.displacement);
+	begin(interpreter, op, address);
+
+	using FlagsRegister::Pending_Op;
+	constexpr bool wide = dst == Operand_Kind::Reg16 || dst == Operand_Kind::Mem16;
+	constexpr u32 mask = wide ? 0xFFFF : 0xFF;
+
+	if constexpr (type == Inst_mov) {
+		writeSlot<dst>(machine, op->dst, address, cast(u16)readSlot<src>(machine, op->src, address));
+	} else if constexpr (type == Inst_add || type == Inst_sub || type == Inst_cmp) {
+		u32 const A = readSlot<dst>(machine, op->dst, address) & mask;
+		u32 const B = readSlot<src>(machine, op->src, address) & mask;
+		u32 const result = ((type == Inst_add) ? A + B : A - B) & mask;
+		if constexpr (flagsLive) {
+			FlagsRegister::setPending(machine, (type == Inst_add) ? Pending_Op::Add : Pending_Op::Sub, A, B, result, wide);
+		}
+		if constexpr (type != Inst_cmp) {
+			writeSlot<dst>(machine, op->dst, address, result);
+		}
+	} else if constexpr (type == Inst_lea) {
+		static_assert(isMem(src));
+		writeSlot<dst>(machine, op->dst, address, address);
+	} else {
+		static_assert(type == Inst_None, "No handler for this instruction.");
+	}
+	return op->next;
+}
+
+#define FOR_EACH_JUMP(X) \
+	X(Inst_jo) X(Inst_jno) X(Inst_jb)  X(Inst_jnb) X(Inst_je)  X(Inst_jne) X(Inst_jbe) X(Inst_ja) \
+	X(Inst_js) X(Inst_jns) X(Inst_jp)  X(Inst_jnp) X(Inst_jl)  X(Inst_jnl) X(Inst_jle) X(Inst_jg) \
+	X(Inst_loopnz) X(Inst_loopz) X(Inst_loop) X(Inst_jcxz)
+
+// getBit: Reads a flag, so the flags can come from somewhere else than the machine.
+template <Instruction_Type type, typename Get_Bit>
+force_inline static inline bool isJumpTaken(Machine& machine, Get_Bit const& getBit) {
+	using FlagsRegister::Bit;
+	switch (type) {
+		case Inst_jo:  return  getBit(Bit::OF);
+		case Inst_jno: return !getBit(Bit::OF);
+		case Inst_jb:  return  getBit(Bit::CF);
+		case Inst_jnb: return !getBit(Bit::CF);
+		case Inst_je:  return  getBit(Bit::ZF);
+		case Inst_jne: return !getBit(Bit::ZF);
+		case Inst_jbe: return  (getBit(Bit::ZF) || getBit(Bit::CF));
+		case Inst_ja:  return !(getBit(Bit::ZF) || getBit(Bit::CF));
+		case Inst_js:  return  getBit(Bit::SF);
+		case Inst_jns: return !getBit(Bit::SF);
+		case Inst_jp:  return  getBit(Bit::PF);
+		case Inst_jnp: return !getBit(Bit::PF);
+		case Inst_jl:  return (getBit(Bit::OF) != getBit(Bit::SF));
+		case Inst_jnl: return (getBit(Bit::OF) == getBit(Bit::SF));
+		case Inst_jle: return  (getBit(Bit::OF) != getBit(Bit::SF) || getBit(Bit::ZF));
+		case Inst_jg:  return !(getBit(Bit::OF) != getBit(Bit::SF) || getBit(Bit::ZF));
+		case Inst_loop:   return --CX_VALUE(machine) != 0;
+		case Inst_loopz:  return --CX_VALUE(machine) != 0 &&  getBit(Bit::ZF);
+		case Inst_loopnz: return --CX_VALUE(machine) != 0 && !getBit(Bit::ZF);
+		case Inst_jcxz: return CX_VALUE(machine) == 0;
+		default: unreachable();
+	}
+}
+
+force_inline static inline Lowered_Op const* endJump(Interpreter& interpreter, Lowered_Op const* op, bool const jumped) {
+	if (jumped) {
+		IP_VALUE(interpreter.machine) = op->targetIP;
+		if (interpreter.jit) interpreter.countHit(op->target);
+		return op->target;
+	}
+	return op->next;
+}
+
+template <Instruction_Type type>
+static Lowered_Op const* op_jump(Interpreter& interpreter, Lowered_Op const* op) {
+	Machine& machine = interpreter.machine;
+	begin(interpreter, op);
+	bool const jumped = isJumpTaken<type>(machine, [&](FlagsRegister::Bit const bit) {
+		return FlagsRegister::getBit(machine, bit);
+	});
+	return endJump(interpreter, op, jumped);
+}
+
+// FlagsRegister::computeBit() with the op and the size known, and the values
+// still at hand, so a jump reading a flag is only the few instructions it takes.
+template <FlagsRegister::Pending_Op op, bool wide>
+force_inline static inline bool computeBit(FlagsRegister::Bit const bit, u32 const A, u32 const B, u32 const result) {
+	using FlagsRegister::Bit;
+	constexpr u32 mask = wide ? 0xFFFF : 0xFF;
+	constexpr u32 sign = wide ? 0x8000 : 0x80;
+	constexpr bool add = op == FlagsRegister::Pending_Op::Add;
+	switch (bit) {
+		case Bit::CF: return add ? (A + B > mask) : (A < B);
+		case Bit::PF: return Count1s(result & 0xFF) % 2 == 0;
+		case Bit::AF: return (A ^ B ^ result) & 0x10;
+		case Bit::ZF: return result == 0;
+		case Bit::SF: return result & sign;
+		case Bit::OF: return add ? ((A ^ result) & (B ^ result) & sign)
+		                         : ((A ^ B) & (A ^ result) & sign);
+		default: unreachable();
+	}
+}
+
+// An add, sub or cmp on registers and the jump right after it, op->next, run
+// as one op. The jump works its flags out from the result right away instead
+// of going through Machine::pendingFlags, which still gets set for whatever
+// reads them later. The clocks and instructions are those of both, and the
+// jump still has an op of its own for the jumps that land on it.
+template <Instruction_Type type, Operand_Kind dst, Operand_Kind src, Instruction_Type jump>
+static Lowered_Op const* op_fused(Interpreter& interpreter, Lowered_Op const* op) {
+	static_assert(!isMem(dst) && !isMem(src));
+	using FlagsRegister::Pending_Op;
+	Machine& machine = interpreter.machine;
+	Lowered_Op const* const jumpOp = op->next;
+	machine.clocks += op->clocks + jumpOp->clocks;
+	IP_VALUE(machine) = jumpOp->nextIP;
+	interpreter.instructions += 2;
+
+	constexpr Pending_Op pendingOp = (type == Inst_add) ? Pending_Op::Add : Pending_Op::Sub;
+	constexpr bool wide = dst == Operand_Kind::Reg16;
+	constexpr u32 mask = wide ? 0xFFFF : 0xFF;
+	u32 const A = readSlot<dst>(machine, op->dst, 0) & mask;
+	u32 const B = readSlot<src>(machine, op->src, 0) & mask;
+	u32 const result = ((type == Inst_add) ? A + B : A - B) & mask;
+	FlagsRegister::setPending(machine, pendingOp, A, B, result, wide);
+	if constexpr (type != Inst_cmp) {
+		writeSlot<dst>(machine, op->dst, 0, result);
+	}
+
+	bool const jumped = isJumpTaken<jump>(machine, [&](FlagsRegister::Bit const bit) {
+		return computeBit<pendingOp, wide>(bit, A, B, result);
+	});
+	return endJump(interpreter, jumpOp, jumped);
+}
+
+// Runs the instructions that only the -exec path knows how to run.
+static Lowered_Op const* op_exec(Interpreter& interpreter, Lowered_Op const* op) {
+	begin(interpreter, op);
+	Decoder_Context decoder(interpreter.code);
+	decoder.bytesRead = op->nextIP;
+	Exec_Trace trace = {};
+	Instruction const inst = interpreter.decoded[op->decodedIndex].unpack();
+	op->exec(interpreter.machine, decoder, inst, trace);
+	return op->next;
+}
+
+static Op_Handler getJumpHandler(Instruction_Type const type) {
+	switch (type) {
+		#define X(T) case T: return op_jump<T>;
+		FOR_EACH_JUMP(X)
+		#undef X
+		default: return nullptr;
+	}
+}
+
+template <Instruction_Type type, Operand_Kind dst, Operand_Kind src>
+static Op_Handler selectFusedHandler(Instruction_Type const jump) {
+	switch (jump) {
+		#define X(T) case T: return op_fused<type, dst, src, T>;
+		FOR_EACH_JUMP(X)
+		#undef X
+		default: unreachable();
+	}
+}
+
+template <Instruction_Type type>
+static Op_Handler selectFusedHandler(Instruction const& inst, Instruction_Type const jump) {
+	Operand_Kind const dst = getOperandKind(inst.dst);
+	Operand_Kind const src = getOperandKind(inst.src);
+	#define X(D, S) if (dst == Operand_Kind::D && src == Operand_Kind::S) return selectFusedHandler<type, Operand_Kind::D, Operand_Kind::S>(jump);
+	X(Reg8, Reg8) X(Reg8, Reg16) X(Reg8, Imm) X(Reg16, Reg8) X(Reg16, Reg16) X(Reg16, Imm)
+	#undef X
+	return nullptr;
+}
+
+// nullptr unless inst is an add, sub or cmp with no memory operand and a jump comes right after it.
+static Op_Handler getFusedHandler(Instruction const& inst, Instruction_Type const following) {
+	if (!IsInstJump(following) || !IsBinaryInstTypeOrderValid(inst)) {
+		return nullptr;
+	}
+	switch (inst.type) {
+		case Inst_add: return selectFusedHandler<Inst_add>(inst, following);
+		case Inst_sub: return selectFusedHandler<Inst_sub>(inst, following);
+		case Inst_cmp: return selectFusedHandler<Inst_cmp>(inst, following);
+		default: return nullptr;
+	}
+}
+
+// Only the memory operand's base gets a template argument, the rest share Base::Direct.
+template <Instruction_Type type, bool flagsLive, Operand_Kind dst, Operand_Kind src>
+static Op_Handler selectBinaryHandler(EffectiveAddress::Base const base) {
+	using Base = EffectiveAddress::Base;
+	if constexpr (dst == Operand_Kind::None || dst == Operand_Kind::Imm || src == Operand_Kind::None ||
+	              (isMem(dst) && isMem(src)) || (type == Inst_lea && !isMem(src))) {
+		Unused(base);
+		return nullptr;
+	} else if constexpr (!isMem(dst) && !isMem(src)) {
+		Unused(base);
+		return op_binary<type, dst, src, Base::Direct, flagsLive>;
+	} else {
+		switch (base) {
+			#define X(B) case Base::B: return op_binary<type, dst, src, Base::B, flagsLive>;
+			X(Direct) X(bx_si) X(bx_di) X(bp_si) X(bp_di) X(si) X(di) X(bp) X(bx)
+			#undef X
+			default: unreachable();
+		}
+	}
+}
+
+template <Instruction_Type type, bool flagsLive, Operand_Kind dst>
+static Op_Handler selectBinaryHandler(Operand_Kind const src, EffectiveAddress::Base const base) {
+	switch (src) {
+		#define X(K) case Operand_Kind::K: return selectBinaryHandler<type, flagsLive, dst, Operand_Kind::K>(base);
+		X(Reg8) X(Reg16) X(Mem8) X(Mem16) X(Imm)
+		#undef X
+		default: return nullptr;
+	}
+}
+
+template <Instruction_Type type, bool flagsLive = true>
+static Op_Handler selectBinaryHandler(Instruction const& inst) {
+	Operand_Kind const src = getOperandKind(inst.src);
+	EffectiveAddress::Base const base = IsOperandMem(inst.dst) ? inst.dst.address.base
+	                                  : IsOperandMem(inst.src) ? inst.src.address.base
+	                                  : EffectiveAddress::Base::Direct;
+	switch (getOperandKind(inst.dst)) {
+		#define X(K) case Operand_Kind::K: return selectBinaryHandler<type, flagsLive, Operand_Kind::K>(src, base);
+		X(Reg8) X(Reg16) X(Mem8) X(Mem16)
+		#undef X
+		default: return nullptr;
+	}
+}
+
+// flagsDead: Nothing reads the flags if it's an add, sub or cmp.
+static Op_Handler getHandler(Instruction const& inst, bool const flagsDead) {
+	if (Op_Handler const jump = getJumpHandler(inst.type)) {
+		return jump;
+	}
+
+	Op_Handler handler = nullptr;
+	switch (inst.type) {
+		#define X(T) flagsDead ? selectBinaryHandler<T, false>(inst) : selectBinaryHandler<T, true>(inst)
+		case Inst_mov: handler = selectBinaryHandler<Inst_mov>(inst); break;
+		case Inst_add: handler = X(Inst_add); break;
+		case Inst_sub: handler = X(Inst_sub); break;
+		case Inst_cmp: handler = X(Inst_cmp); break;
+		#undef X
+		case Inst_lea: handler = selectBinaryHandler<Inst_lea>(inst); break;
+		default: return op_exec;
+	}
+	if (!IsBinaryInstTypeOrderValid(inst)) {
+		return op_nop;
+	}
+	assertTrue(handler != nullptr);
+	return handler;
+}
+
+Interpreter::Interpreter(Machine& TargetMachine, Slice<u8> const Code, u16 const FirstIP): machine(TargetMachine), code(Code), firstIP(FirstIP), opIndexByIP(Code.count, -1) {
+	// One op per IP at most, so the ops never move once they're pointed at.
+	ops.reserve(code.count - firstIP);
+	halt = {.handler = op_halt};
+}
+
+Lowered_Op const* Interpreter::opAt(i64 const ip) {
+	if (ip < firstIP || ip >= code.count) {
+		return &halt;
+	}
+	i32& idx = opIndexByIP[ip];
+	if (idx < 0) {
+		idx = cast(i32)ops.size();
+		ops.push_back(Lowered_Op{.handler = op_lower, .ip = cast(u16)ip});
+	}
+	return &ops[idx];
+}
+
+Lowered_Op const* Interpreter::loweredAt(i64 const ip) {
+	Lowered_Op const* op = opAt(ip);
+	if (op->handler == op_lower) {
+		lowerOp(ops[op - ops.data()]);
+	}
+	if (op == &halt || op->handler == op_unrecognized) {
+		return nullptr;
+	}
+	return op;
+}
+
+void Interpreter::countHit(Lowered_Op const* const target) {
+	if (target == &halt) return;
+	Lowered_Op& op = ops[target - ops.data()];
+	if (op.handler == op_jitted || ++op.hits != JIT_HOT_THRESHOLD) return;
+	if (Jit_Code const code = jit->compileBlock(*this, op.ip)) {
+		op.jitted = code;
+		op.interpreted = op.handler;
+		op.handler = op_jitted;
+	}
+}
+
+void Interpreter::lowerOp(Lowered_Op& op) {
+	Decoder_Context decoder(code);
+	decoder.bytesRead = op.ip;
+	Decoded_Instruction current;
+	Opcode_Entry const* entry = decodeNext(decoder, current);
+	if (entry == nullptr) {
+		op.handler = op_unrecognized;
+		return;
+	}
+	Instruction const& inst = current.inst;
+
+	op.handler = getHandler(inst, flagLiveness && flagLiveness->isDead(op.ip - firstIP));
+	op.dst = lowerOperand(inst.dst);
+	op.src = lowerOperand(inst.src);
+	op.nextIP = op.ip + current.size;
+	op.exec = entry->exec;
+	op.decodedIndex = cast(u32)decoded.size();
+	decoded.push_back(Packed_Instruction::pack(inst));
+
+	Clock_Calculation const calculation = getInstructionClocksCalculation(inst);
+	for (u8 i = 0; i < calculation.part_count; i++) {
+		Clock_Calculation_Part const& part = calculation.parts[i];
+		if (part.type == Clock_16bitTransfer) {
+			// Always the address of the memory operand, which the handler computes anyway.
+			op.transfers = part.transfer.count;
+		} else {
+			op.clocks += getPartClocks(machine, part);
+		}
+	}
+
+	assertTrue(op.transfers == 0 || (op.handler != op_nop && op.handler != op_exec));
+
+	op.next = opAt(op.nextIP);
+	if (IsOperandJump(inst.dst)) {
+		i64 const target = cast(i64)op.nextIP + inst.dst.jump_offset;
+		op.targetIP = cast(u16)target;
+		op.target = opAt(target);
+	}
+
+	// What comes next only gets decoded to look at it. Lowering a jump right
+	// away is fine, but a run of adds would go down every one of them.
+	// An instruction cut off by the end of code doesn't decode, so isn't fused.
+	if (op.handler != op_exec && op.nextIP < code.count) {
+		Decoded_Instruction following;
+		decoder.resetByteStack();
+		decoder.bytesRead = op.nextIP;
+		if (decodeNext(decoder, following) != nullptr) {
+			if (Op_Handler const fused = getFusedHandler(inst, following.inst.type)) {
+				loweredAt(op.nextIP);
+				op.handler = fused;
+			}
+		}
+	}
+}
+
+bool Interpreter::run(Simulation_Stats& stats) {
+	auto const start = std::chrono::high_resolution_clock::now();
+
+	Lowered_Op const* op = opAt(getIP(machine));
+	while (op != nullptr) {
+		op = op->handler(*this, op);
+	}
+
+	std::chrono::duration<f64> const elapsed = std::chrono::high_resolution_clock::now() - start;
+	stats.instructions = instructions;
+	stats.seconds = elapsed.count();
+	stats.clocks = machine.clocks;
+	return unrecognizedOffset < 0;
+}
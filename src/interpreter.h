@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "decoder.h"
+#include "opcode_table.h"
+#include "instruction_stream.h"
+
+// Runs programs for -run without going back to the decoder. Every instruction
+// is lowered once into a Lowered_Op: a handler plus operands that were already
+// resolved, and each handler hands back the op that runs next, so the loop in
+// run() is only an indirect call.
+//
+// Ops start out as stubs that lower themselves the first time they run, so
+// only the bytes that execution reaches get decoded, same as with -exec. They
+// get decoded from Machine::memory, but only once, so a program that writes
+// over its own code goes on running what was there before.
+
+struct Interpreter;
+struct Lowered_Op;
+struct Jit;
+struct Flag_Liveness;
+typedef Lowered_Op const* (*Op_Handler)(Interpreter& interpreter, Lowered_Op const* op);
+// A compiled block, returns the IP it stopped at, see jit.h.
+typedef i64 (*Jit_Code)(Machine* machine, u64* instructions);
+
+// What an operand is, as far as reading and writing it goes. Handlers are
+// instantiated per combination, so nothing gets switched on while running.
+enum struct Operand_Kind : u8 { None = 0, Reg8, Reg16, Mem8, Mem16, Imm };
+
+constexpr bool isMem(Operand_Kind const kind) {
+	return kind == Operand_Kind::Mem8 || kind == Operand_Kind::Mem16;
+}
+
+Operand_Kind getOperandKind(Instruction_Operand const& operand);
+
+// An operand with everything that doesn't depend on the registers worked out.
+// What kind of operand it is is part of the handler, see op_binary().
+struct Operand_Slot {
+	union {
+		u8 reg;            // Byte offset into Machine::registers, see getRegisterOffset().
+		u32 displacement;  // Sign extended, the base registers are added by the handler.
+		u32 immediate;
+	};
+};
+
+struct Lowered_Op {
+	Op_Handler handler;
+	Operand_Slot dst, src;
+	Lowered_Op const* next;    // Where execution falls through to.
+	Lowered_Op const* target;  // Where a taken jump goes.
+	u16 ip, nextIP, targetIP;
+
+	// The clocks are known when lowering, except for the odd-address penalty
+	// of a 16-bit transfer, which the handler checks against its memory operand.
+	u16 clocks;
+	u8 transfers;
+
+	union {
+		Exec_Proc exec;           // For the instructions without a handler of their own.
+		Op_Handler interpreted;   // What handler was before the op got jitted.
+	};
+	u32 decodedIndex;          // Into Interpreter::decoded.
+	u32 hits;                  // Taken jumps and compiled blocks that went here, while there's a Jit.
+	Jit_Code jitted;
+};
+
+struct Interpreter {
+	Machine& machine;
+	Slice<u8> const code;          // The code segment as Machine::load() returns it, indexed by IP.
+	u16 const firstIP;             // Where the program starts in code.
+	std::vector<Packed_Instruction> decoded;
+	std::vector<Lowered_Op> ops;   // Reserved up front since the ops point at each other.
+	std::vector<i32> opIndexByIP;  // -1 while nothing refers to that IP.
+	Lowered_Op halt;               // Reached by running past either end of the program.
+	u64 instructions = 0;
+	i64 unrecognizedOffset = -1;   // The IP that didn't decode, unrecognized or cut off by the end of code.
+	Jit* jit = nullptr;            // Compiles the ops that get hot, if there is one.
+	// Which add, sub and cmp don't need to set the flags, if the program could be analyzed.
+	Flag_Liveness const* flagLiveness = nullptr;
+
+	Interpreter(Machine& TargetMachine, Slice<u8> Code, u16 FirstIP);
+
+	// Starts at the IP the Machine has, returns false if execution reached a byte that doesn't decode.
+	bool run(Simulation_Stats& stats);
+
+	// The op for an IP, a stub if it wasn't needed before.
+	Lowered_Op const* opAt(i64 ip);
+	void lowerOp(Lowered_Op& op);
+	// Same as opAt() but lowered already, nullptr for the halt op or a byte that doesn't decode.
+	Lowered_Op const* loweredAt(i64 ip);
+	// Called by the jumps with where they went, compiles the op once it gets hot.
+	void countHit(Lowered_Op const* target);
+};
@@ -0,0 +1,563 @@
+#include "jit.h"
+
+#include <cstddef>
+
+#if JIT_SUPPORTED
+	#include <sys/mman.h>
+#endif
+
+// Where things are in the Machine, which stays in rdi.
+#define MACHINE_REGISTERS cast(i32)offsetof(Machine, registers)
+#define MACHINE_MEMORY    cast(i32)offsetof(Machine, memory)
+#define MACHINE_CLOCKS    cast(i32)offsetof(Machine, clocks)
+#define MACHINE_IP        cast(i32)(offsetof(Machine, registers) + 2 * RegToID(Register::ip))
+#define PENDING(member)   cast(i32)(offsetof(Machine, pendingFlags) + offsetof(FlagsRegister::Pending, member))
+
+// The condition codes of jo..jg are their position after Inst_jo, same as on x86.
+#define CC_E  0x4
+#define CC_NE 0x5
+#define CC_A  0x7
+
+// The host registers by their encoding. eax, ecx and edx are scratch, ebx and
+// ebp keep the operands of the last add, sub or cmp, and r8..r15 hold the
+// eight general registers (in Register order, so bx is r9 and cx is r10) for
+// as long as the block runs. Everything is kept zero extended to 32 bits.
+enum Host_Register : u8 { EAX = 0, ECX = 1, EDX = 2, EBX = 3, EBP = 5, R8 = 8 };
+#define JIT_CACHED_REGISTERS 8
+
+force_inline static inline u8 getHostRegister(u32 const guest) {
+	return R8 + guest;
+}
+
+// Writes x86-64 into what's left of the buffer. Nothing past the end gets
+// written, but count keeps going so the caller can tell it didn't fit.
+struct Jit_Assembler {
+	u8* code;
+	size_t count;
+	size_t capacity;
+
+	void byte(u8 const value) {
+		if (count < capacity) code[count] = value;
+		count++;
+	}
+
+	void word(u16 const value) {
+		byte(value & 0xFF);
+		byte(value >> 8);
+	}
+
+	void dword(u32 const value) {
+		word(value & 0xFFFF);
+		word(value >> 16);
+	}
+
+	// byteRegister: spl, bpl, sil and dil need a REX, without one they'd be ah, ch, dh and bh.
+	void rex(bool const w, u8 const reg, u8 const rm, bool const byteRegister = false) {
+		u8 const value = 0x40 | (w << 3) | ((reg >> 3) << 2) | (rm >> 3);
+		bool const needed = byteRegister && ((reg >= 4 && reg < 8) || (rm >= 4 && rm < 8));
+		if (value != 0x40 || needed) byte(value);
+	}
+
+	void registers(u8 const reg, u8 const rm) {
+		byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+	}
+
+	// [rdi + disp32], or [rdi + rax + disp32] when indexed.
+	void memoryOperand(u8 const reg, bool const indexed, i32 const disp) {
+		if (indexed) {
+			byte(0x84 | ((reg & 7) << 3));
+			byte(0x07);
+		} else {
+			byte(0x87 | ((reg & 7) << 3));
+		}
+		dword(cast(u32)disp);
+	}
+
+	// The "op r/m32, r32" form: 0x01 add, 0x29 sub, 0x09 or, 0x89 mov, 0x85 test.
+	void alu(u8 const opcode, u8 const rm, u8 const reg) {
+		rex(false, reg, rm);
+		byte(opcode);
+		registers(reg, rm);
+	}
+
+	// The same on the low 16 or 8 bits, for redoing an add or a cmp to get its flags.
+	void alu16(u8 const opcode, u8 const rm, u8 const reg) {
+		byte(0x66);
+		alu(opcode, rm, reg);
+	}
+
+	void alu8(u8 const opcode, u8 const rm, u8 const reg) {
+		rex(false, reg, rm, true);
+		byte(opcode);
+		registers(reg, rm);
+	}
+
+	// 81 /extension: 0 add, 4 and, 5 sub, 7 cmp.
+	void aluImmediate(u8 const extension, u8 const rm, u32 const value) {
+		rex(false, 0, rm);
+		byte(0x81);
+		registers(extension, rm);
+		dword(value);
+	}
+
+	// C1 /extension: 4 shl, 5 shr.
+	void shift(u8 const extension, u8 const rm, u8 const amount) {
+		rex(false, 0, rm);
+		byte(0xC1);
+		registers(extension, rm);
+		byte(amount);
+	}
+
+	void mov(u8 const dst, u8 const src) {
+		alu(0x89, dst, src);
+	}
+
+	void movImmediate(u8 const dst, u32 const value) {
+		rex(false, 0, dst);
+		byte(0xB8 + (dst & 7));
+		dword(value);
+	}
+
+	void movzx16(u8 const dst, u8 const src) {
+		rex(false, dst, src);
+		byte(0x0F); byte(0xB7);
+		registers(dst, src);
+	}
+
+	void movzx8(u8 const dst, u8 const src) {
+		rex(false, dst, src, true);
+		byte(0x0F); byte(0xB6);
+		registers(dst, src);
+	}
+
+	// mov dst8, src8
+	void movByte(u8 const dst, u8 const src) {
+		rex(false, src, dst, true);
+		byte(0x88);
+		registers(src, dst);
+	}
+
+	void load(bool const wide, u8 const reg, bool const indexed, i32 const disp) {
+		rex(false, reg, 0);
+		byte(0x0F); byte(wide ? 0xB7 : 0xB6);
+		memoryOperand(reg, indexed, disp);
+	}
+
+	void store(bool const wide, u8 const reg, bool const indexed, i32 const disp) {
+		if (wide) byte(0x66);
+		rex(false, reg, 0, !wide);
+		byte(wide ? 0x89 : 0x88);
+		memoryOperand(reg, indexed, disp);
+	}
+
+	void storeByteImmediate(i32 const disp, u8 const value) {
+		byte(0xC6); memoryOperand(0, false, disp); byte(value);
+	}
+
+	void storeWordImmediate(i32 const disp, u16 const value) {
+		byte(0x66); byte(0xC7); memoryOperand(0, false, disp); word(value);
+	}
+
+	// add qword [rdi + disp32], imm32
+	void addQwordImmediate(i32 const disp, u32 const value) {
+		byte(0x48); byte(0x81); memoryOperand(0, false, disp); dword(value);
+	}
+
+	// Returns where the rel32 goes, for patch().
+	size_t jcc(u8 const condition) {
+		byte(0x0F); byte(0x80 | condition);
+		dword(0);
+		return count - 4;
+	}
+
+	size_t jmp() {
+		byte(0xE9);
+		dword(0);
+		return count - 4;
+	}
+
+	void patch(size_t const at, size_t const target) {
+		i32 const rel = cast(i32)(target - (at + 4));
+		for (size_t i = 0; i < 4; i++) {
+			if (at + i < capacity) code[at + i] = (cast(u32)rel >> (8 * i)) & 0xFF;
+		}
+	}
+};
+
+static bool isCompilable(Instruction const& inst) {
+	switch (inst.type) {
+		case Inst_mov: case Inst_add: case Inst_sub: case Inst_cmp: case Inst_lea: break;
+		default: return false;
+	}
+	// The same combinations the interpreter has an op_binary() for.
+	Operand_Kind const dst = getOperandKind(inst.dst);
+	Operand_Kind const src = getOperandKind(inst.src);
+	if (dst == Operand_Kind::None || dst == Operand_Kind::Imm || src == Operand_Kind::None) return false;
+	if (isMem(dst) && isMem(src)) return false;
+	if (inst.type == Inst_lea && !isMem(src)) return false;
+	return IsBinaryInstTypeOrderValid(inst);
+}
+
+// The general registers in the sum of an effective address, -1 where there's none.
+static void getAddressRegisters(EffectiveAddress::Base const base, i32& first, i32& second) {
+	using Base = EffectiveAddress::Base;
+	#define R(r) cast(i32)RegToID(Register::r)
+	first = -1, second = -1;
+	switch (base) {
+		case Base::bx_si:  first = R(b);  second = R(si); break;
+		case Base::bx_di:  first = R(b);  second = R(di); break;
+		case Base::bp_si:  first = R(bp); second = R(si); break;
+		case Base::bp_di:  first = R(bp); second = R(di); break;
+		case Base::si:     first = R(si); break;
+		case Base::di:     first = R(di); break;
+		case Base::bp:     first = R(bp); break;
+		case Base::bx:     first = R(b);  break;
+		case Base::Direct: break;
+	}
+	#undef R
+}
+
+// Which of the cached registers an operand touches, one bit each.
+static u8 getRegisterMask(Instruction_Operand const& operand) {
+	if (IsOperandReg(operand)) {
+		u32 const id = RegToID(operand.reg.type);
+		return (id < JIT_CACHED_REGISTERS) ? (1 << id) : 0;
+	}
+	if (IsOperandMem(operand)) {
+		i32 first, second;
+		getAddressRegisters(operand.address.base, first, second);
+		return ((first >= 0) ? (1 << first) : 0) | ((second >= 0) ? (1 << second) : 0);
+	}
+	return 0;
+}
+
+struct Jit_Step {
+	Lowered_Op const* op;
+	Instruction inst;
+	u64 clocksBefore;                    // The static clocks of the steps before this one.
+	FlagsRegister::Pending_Op setter;    // The last add, sub or cmp before this one, if any.
+	bool setterWide;
+	size_t boundsCheck;                  // The jump to this step's side exit, 0 if it has none.
+	size_t label;                        // Where its code starts.
+	size_t taken;                        // For a jump, the jcc to patch with where it goes.
+};
+
+// Emits one block, see Jit::compileBlock().
+struct Jit_Block {
+	Jit_Assembler a;
+	u8 usedRegisters;     // Loaded on the way in.
+	u8 writtenRegisters;  // Stored on the way out.
+
+	// eax = the same sum as getAddress() in interpreter.cpp.
+	void address(EffectiveAddress::Base const base, u32 const displacement) {
+		i32 first, second;
+		getAddressRegisters(base, first, second);
+		if (first < 0) {
+			a.movImmediate(EAX, displacement);
+			return;
+		}
+		a.mov(EAX, getHostRegister(first));
+		if (second >= 0) a.alu(0x01, EAX, getHostRegister(second));
+		if (displacement != 0) a.aluImmediate(0, EAX, displacement);
+	}
+
+	void load(Operand_Kind const kind, Host_Register const scratch, Operand_Slot const& slot) {
+		u32 const id = slot.reg / 2;
+		switch (kind) {
+			case Operand_Kind::Reg8: {
+				if (slot.reg % 2 == 0) {
+					a.movzx8(scratch, getHostRegister(id));
+				} else {
+					a.mov(scratch, getHostRegister(id));
+					a.shift(5, scratch, 8);
+				}
+			} break;
+			case Operand_Kind::Reg16: {
+				if (id < JIT_CACHED_REGISTERS) a.mov(scratch, getHostRegister(id));
+				else a.load(true, scratch, false, MACHINE_REGISTERS + slot.reg);
+			} break;
+			case Operand_Kind::Mem8:  a.load(false, scratch, true, MACHINE_MEMORY); break;
+			case Operand_Kind::Mem16: a.load(true, scratch, true, MACHINE_MEMORY); break;
+			case Operand_Kind::Imm:   a.movImmediate(scratch, slot.immediate); break;
+			default: unreachable();
+		}
+	}
+
+	// Writes the low 8 or 16 bits of scratch, and might change the rest of it.
+	void store(Operand_Kind const kind, Host_Register const scratch, Operand_Slot const& slot) {
+		u32 const id = slot.reg / 2;
+		switch (kind) {
+			case Operand_Kind::Reg8: {
+				u8 const host = getHostRegister(id);
+				if (slot.reg % 2 == 0) {
+					a.movByte(host, scratch);
+				} else {
+					a.movzx8(scratch, scratch);
+					a.shift(4, scratch, 8);
+					a.aluImmediate(4, host, 0xFFFF00FF);
+					a.alu(0x09, host, scratch);
+				}
+			} break;
+			case Operand_Kind::Reg16: {
+				if (id < JIT_CACHED_REGISTERS) a.movzx16(getHostRegister(id), scratch);
+				else a.store(true, scratch, false, MACHINE_REGISTERS + slot.reg);
+			} break;
+			case Operand_Kind::Mem8:  a.store(false, scratch, true, MACHINE_MEMORY); break;
+			case Operand_Kind::Mem16: a.store(true, scratch, true, MACHINE_MEMORY); break;
+			default: unreachable();
+		}
+	}
+
+	// Leaves Machine::pendingFlags the way the last add, sub or cmp would have.
+	void storePending(FlagsRegister::Pending_Op const setter, bool const wide) {
+		if (setter == FlagsRegister::Pending_Op::None) return;
+		a.store(true, EBX, false, PENDING(A));
+		a.store(true, EBP, false, PENDING(B));
+		a.mov(EDX, EBX);
+		a.alu((setter == FlagsRegister::Pending_Op::Add) ? 0x01 : 0x29, EDX, EBP);
+		a.aluImmediate(4, EDX, wide ? 0xFFFF : 0xFF);
+		a.store(true, EDX, false, PENDING(result));
+		a.storeByteImmediate(PENDING(op), static_cast<u8>(setter));
+		a.storeByteImmediate(PENDING(wide), wide);
+	}
+
+	// Sets the host flags the way the last add, sub or cmp would have.
+	void redoSetter(FlagsRegister::Pending_Op const setter, bool const wide) {
+		u8 const opcode = (setter == FlagsRegister::Pending_Op::Add) ? 0x01 : 0x39;
+		a.mov(EDX, EBX);
+		if (wide) a.alu16(opcode, EDX, EBP);
+		else a.alu8(opcode - 1, EDX, EBP);
+	}
+
+	// Negative when a jump skips steps the rest of the block counts as having run.
+	void account(i64 const clocks, i64 const instructions) {
+		if (clocks != 0) a.addQwordImmediate(MACHINE_CLOCKS, cast(u32)cast(i32)clocks);
+		if (instructions != 0) {
+			a.byte(0x48); a.byte(0x81); a.byte(0x06); a.dword(cast(u32)cast(i32)instructions); // add qword [rsi], imm32
+		}
+	}
+
+	// Hands everything back to the Machine and returns ip.
+	void leave(i64 const ip, i64 const clocks, i64 const instructions, FlagsRegister::Pending_Op const setter, bool const wide) {
+		storePending(setter, wide);
+		for (u32 id = 0; id < JIT_CACHED_REGISTERS; id++) {
+			if ((writtenRegisters >> id) & 1) a.store(true, getHostRegister(id), false, MACHINE_REGISTERS + 2 * id);
+		}
+		account(clocks, instructions);
+		a.storeWordImmediate(MACHINE_IP, cast(u16)ip);
+		a.byte(0x41); a.byte(0x5F); a.byte(0x41); a.byte(0x5E); // pop r15, pop r14
+		a.byte(0x41); a.byte(0x5D); a.byte(0x41); a.byte(0x5C); // pop r13, pop r12
+		a.byte(0x5D); a.byte(0x5B);                             // pop rbp, pop rbx
+		a.byte(0x48); a.byte(0xC7); a.byte(0xC0); a.dword(cast(u32)cast(i32)ip); // mov rax, imm32
+		a.byte(0xC3);
+	}
+
+	void enter() {
+		a.byte(0x53); a.byte(0x55);                             // push rbx, push rbp
+		a.byte(0x41); a.byte(0x54); a.byte(0x41); a.byte(0x55); // push r12, push r13
+		a.byte(0x41); a.byte(0x56); a.byte(0x41); a.byte(0x57); // push r14, push r15
+		for (u32 id = 0; id < JIT_CACHED_REGISTERS; id++) {
+			if ((usedRegisters >> id) & 1) a.load(true, getHostRegister(id), false, MACHINE_REGISTERS + 2 * id);
+		}
+	}
+
+	// Sets up the host flags for a jump, and returns the jcc that's taken when it jumps.
+	size_t condition(Jit_Step const& step) {
+		Instruction_Type const type = step.inst.type;
+		u8 const cx = getHostRegister(RegToID(Register::c));
+		if (type >= Inst_jo && type <= Inst_jg) {
+			redoSetter(step.setter, step.setterWide);
+			return a.jcc(cast(u8)(type - Inst_jo));
+		}
+		if (type == Inst_jcxz) {
+			a.alu(0x85, cx, cx); // test cx, cx
+			return a.jcc(CC_E);
+		}
+		a.byte(0x66); a.rex(false, 0, cx); a.byte(0x83); a.registers(5, cx); a.byte(1); // sub cx, 1
+		if (type == Inst_loop) return a.jcc(CC_NE);
+		// loopz and loopnz also stay once cx gets to 0, whatever ZF says.
+		size_t const cxZero = a.jcc(CC_E);
+		redoSetter(step.setter, step.setterWide);
+		size_t const taken = a.jcc((type == Inst_loopz) ? CC_E : CC_NE);
+		a.patch(cxZero, a.count);
+		return taken;
+	}
+
+	// One mov, add, sub, cmp or lea, same as op_binary() does it.
+	void binary(Jit_Step& step) {
+		Lowered_Op const* op = step.op;
+		Instruction const& inst = step.inst;
+		Operand_Kind const dst = getOperandKind(inst.dst);
+		Operand_Kind const src = getOperandKind(inst.src);
+
+		if (isMem(dst) || isMem(src)) {
+			Instruction_Operand const& mem = isMem(dst) ? inst.dst : inst.src;
+			address(mem.address.base, isMem(dst) ? op->dst.displacement : op->src.displacement);
+			if (inst.type != Inst_lea) {
+				u32 const size = (isMem(dst) ? dst : src) == Operand_Kind::Mem16 ? 2 : 1;
+				a.aluImmediate(7, EAX, MEMORY_SIZE_8086 - size);
+				step.boundsCheck = a.jcc(CC_A);
+			}
+			if (op->transfers > 0) {
+				// The odd address penalty, without a branch.
+				a.mov(ECX, EAX);
+				a.aluImmediate(4, ECX, 1);
+				a.byte(0x6B); a.registers(ECX, ECX); a.byte(4 * op->transfers); // imul ecx, ecx, imm8
+				a.byte(0x48); a.byte(0x01); a.memoryOperand(ECX, false, MACHINE_CLOCKS); // add [clocks], rcx
+			}
+		}
+
+		bool const wide = dst == Operand_Kind::Reg16 || dst == Operand_Kind::Mem16;
+		u32 const mask = wide ? 0xFFFF : 0xFF;
+		switch (inst.type) {
+			case Inst_mov: {
+				load(src, ECX, op->src);
+				store(dst, ECX, op->dst);
+			} break;
+
+			case Inst_lea: {
+				store(dst, EAX, op->dst);
+			} break;
+
+			case Inst_add: case Inst_sub: case Inst_cmp: {
+				load(dst, EDX, op->dst);
+				load(src, ECX, op->src);
+				if (src == Operand_Kind::Imm || (!wide && (src == Operand_Kind::Reg16 || src == Operand_Kind::Mem16))) {
+					a.aluImmediate(4, ECX, mask);
+				}
+				a.mov(EBX, EDX);
+				a.mov(EBP, ECX);
+				if (inst.type != Inst_cmp) {
+					a.alu((inst.type == Inst_add) ? 0x01 : 0x29, EDX, ECX);
+					store(dst, EDX, op->dst);
+				}
+			} break;
+
+			default: unreachable();
+		}
+	}
+};
+
+Jit::Jit() {
+#if JIT_SUPPORTED
+	void* const mapped = mmap(nullptr, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	buffer = (mapped == MAP_FAILED) ? nullptr : static_cast<u8*>(mapped);
+#endif
+}
+
+Jit::~Jit() {
+#if JIT_SUPPORTED
+	if (buffer != nullptr) munmap(buffer, JIT_BUFFER_SIZE);
+#endif
+}
+
+Jit_Code Jit::compileBlock(Interpreter& interpreter, u16 const ip) {
+#if !JIT_SUPPORTED
+	Unused(interpreter); Unused(ip);
+	return nullptr;
+#else
+	using FlagsRegister::Pending_Op;
+	if (buffer == nullptr) return nullptr;
+
+	// Picks the instructions first. The block goes on past a jump that isn't
+	// taken, and ends where an instruction can't be compiled.
+	Jit_Step steps[JIT_MAX_BLOCK_INSTRUCTIONS];
+	u32 count = 0;
+	i64 endIP = ip;
+	Pending_Op setter = Pending_Op::None;
+	bool setterWide = false;
+	u64 clocks = 0;
+	u8 usedRegisters = 0, writtenRegisters = 0;
+	while (count < JIT_MAX_BLOCK_INSTRUCTIONS) {
+		Lowered_Op const* op = interpreter.loweredAt(endIP);
+		if (op == nullptr) break;
+		Instruction const inst = interpreter.decoded[op->decodedIndex].unpack();
+		if (IsInstJump(inst.type)) {
+			bool const conditional = inst.type >= Inst_jo && inst.type <= Inst_jg;
+			// The flags have to come from this block, since it doesn't know what the pending op was before it.
+			if (inst.type != Inst_loop && inst.type != Inst_jcxz && setter == Pending_Op::None) break;
+			u8 const cx = 1 << RegToID(Register::c);
+			if (!conditional) usedRegisters |= cx;
+			if (!conditional && inst.type != Inst_jcxz) writtenRegisters |= cx;
+		} else if (isCompilable(inst)) {
+			usedRegisters |= getRegisterMask(inst.dst) | getRegisterMask(inst.src);
+			if (inst.type != Inst_cmp && IsOperandReg(inst.dst)) {
+				writtenRegisters |= getRegisterMask(inst.dst);
+			}
+		} else {
+			break;
+		}
+		steps[count++] = {.op = op, .inst = inst, .clocksBefore = clocks, .setter = setter, .setterWide = setterWide};
+		if (inst.type == Inst_add || inst.type == Inst_sub || inst.type == Inst_cmp) {
+			setter = (inst.type == Inst_add) ? Pending_Op::Add : Pending_Op::Sub;
+			setterWide = IsOperandMem16(inst.dst) || (IsOperandReg(inst.dst) && inst.dst.reg.usage == RegisterUsage::x);
+		}
+		clocks += op->clocks;
+		endIP = op->nextIP;
+	}
+	if (count == 0) return nullptr;
+
+	size_t const start = (used + 15) & ~cast(size_t)15;
+	if (start >= JIT_BUFFER_SIZE) return nullptr;
+	if (mprotect(buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE) != 0) return nullptr;
+	defer(mprotect(buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC));
+	Jit_Block block = {
+		.a = {.code = buffer + start, .count = 0, .capacity = JIT_BUFFER_SIZE - start},
+		.usedRegisters = cast(u8)(usedRegisters | writtenRegisters),
+		.writtenRegisters = writtenRegisters,
+	};
+	Jit_Assembler& a = block.a;
+
+	block.enter();
+	for (u32 i = 0; i < count; i++) {
+		Jit_Step& step = steps[i];
+		step.label = a.count;
+		if (IsInstJump(step.inst.type)) {
+			step.taken = block.condition(step);
+		} else {
+			block.binary(step);
+		}
+	}
+	block.leave(endIP, clocks, count, setter, setterWide);
+
+	// Where the jumps go when they're taken. Each exit counts the steps before
+	// it as having run, so a jump within the block makes up the difference.
+	for (u32 i = 0; i < count; i++) {
+		Jit_Step const& step = steps[i];
+		if (!IsInstJump(step.inst.type)) continue;
+		a.patch(step.taken, a.count);
+		i64 const target = cast(i64)step.op->nextIP + step.inst.dst.jump_offset;
+		u64 const clocksThrough = step.clocksBefore + step.op->clocks;
+
+		u32 j = 0;
+		while (j < count && steps[j].op->ip != target) j++;
+		// The steps there expect the last add, sub or cmp to be the same kind,
+		// or to find it in the Machine if there wasn't one before them.
+		// steps[j] is only there to look at when the target is in the block.
+		bool const inside = j < count;
+		bool const sameSetter = inside && steps[j].setter == step.setter && steps[j].setterWide == step.setterWide;
+		if (!inside || !(sameSetter || steps[j].setter == Pending_Op::None)) {
+			block.leave(target, clocksThrough, i + 1, step.setter, step.setterWide);
+			continue;
+		}
+		if (!sameSetter) block.storePending(step.setter, step.setterWide);
+		block.account(cast(i64)clocksThrough - cast(i64)steps[j].clocksBefore, cast(i64)(i + 1) - j);
+		a.patch(a.jmp(), steps[j].label);
+	}
+
+	// Stops before the step with the memory operand that's out of bounds.
+	for (u32 i = 0; i < count; i++) {
+		Jit_Step const& step = steps[i];
+		if (step.boundsCheck == 0) continue;
+		a.patch(step.boundsCheck, a.count);
+		block.leave(step.op->ip, step.clocksBefore, i, step.setter, step.setterWide);
+	}
+
+	if (a.count > a.capacity) {
+		used = JIT_BUFFER_SIZE;
+		return nullptr;
+	}
+	used = start + a.count;
+	return reinterpret_cast<Jit_Code>(buffer + start);
+#endif
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "interpreter.h"
+
+// Compiles the blocks that -run spends its time in to x86-64, for -jit.
+//
+// A taken jump counts a hit on the op it lands on, and after JIT_HOT_THRESHOLD
+// of them the code starting there becomes one function that does what the
+// handlers would have done: the same registers, memory, pending flags and
+// Machine::clocks. A block goes on past jumps that aren't taken, as far as the
+// first instruction it doesn't know (anything but mov, add, sub, cmp, lea and
+// the jumps), which stays with the interpreter. Jumps to somewhere inside the
+// block stay inside, so a loop runs without leaving it, with the registers
+// kept in host registers.
+//
+// The code is called as a Jit_Code, with the Machine in rdi and the count of
+// Interpreter::instructions in rsi, and returns the IP to go on from, which
+// is also in the IP register by then. It stops before any memory operand that
+// isn't in bounds, so the handler can fail on it the way it always does.
+
+#if defined(__x86_64__) && !defined(_WIN32)
+	#define JIT_SUPPORTED 1
+#else
+	#define JIT_SUPPORTED 0
+#endif
+
+#define JIT_HOT_THRESHOLD 64
+#define JIT_BUFFER_SIZE (4 * 1024 * 1024)
+#define JIT_MAX_BLOCK_INSTRUCTIONS 64
+
+struct Jit {
+	u8* buffer = nullptr;  // Mapped executable, and writable only while compiling.
+	size_t used = 0;
+
+	Jit();
+	~Jit();
+	Jit(Jit const&) = delete;
+	Jit& operator=(Jit const&) = delete;
+
+	// nullptr if the block can't start with the instruction at ip, or if there's no room left.
+	Jit_Code compileBlock(Interpreter& interpreter, u16 ip);
+};
@@ -1,6 +1,33 @@
 #pragma once
 
 #include "decoder.h"
+#include "opcode_table.h"
 
-bool isByte_Jump(u8 byte);
-void decode_Jump(Decoder_Context& decoder, u8& byte);
+constexpr Instruction_Type jumpTypeFromByte(u8 const byte) {
+	switch (byte) {
+		case 0b01110000: return Inst_jo;
+		case 0b01110001: return Inst_jno;
+		case 0b01110010: return Inst_jb;
+		case 0b01110011: return Inst_jnb;
+		case 0b01110100: return Inst_je;
+		case 0b01110101: return Inst_jne;
+		case 0b01110110: return Inst_jbe;
+		case 0b01110111: return Inst_ja;
+		case 0b01111000: return Inst_js;
+		case 0b01111001: return Inst_jns;
+		case 0b01111010: return Inst_jp;
+		case 0b01111011: return Inst_jnp;
+		case 0b01111100: return Inst_jl;
+		case 0b01111101: return Inst_jnl;
+		case 0b01111110: return Inst_jle;
+		case 0b01111111: return Inst_jg;
+		case 0b11100000: return Inst_loopnz;
+		case 0b11100001: return Inst_loopz;
+		case 0b11100010: return Inst_loop;
+		case 0b11100011: return Inst_jcxz;
+		default:         return Inst_None;
+	}
+}
+
+Decoded_Instruction decode_Jump(Decoder_Context& decoder, u8& byte, Opcode_Entry const& entry);
+void exec_Jump(Machine& machine, Decoder_Context& decoder, Instruction const& inst, Exec_Trace& trace);
@@ -1,12 +1,28 @@
+#include <cctype>
+#include <cerrno>
 #include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
 
 #include "string_builder.h"
 #include "decoder.h"
+#include "decode_stream.h"
+#include "assembler.h"
+#include "binary_cache.h"
+#include "file_bytes.h"
+#include "encoder.h"
+#include "instruction_lengths.h"
+#include "control_flow.h"
+#include "jit.h"
+#include "translate.h"
 #include "util.h"
 
 String_View getFileName(const char* path) {
@@ -19,25 +35,6 @@ String_View getFileName(const char* path) {
 	return parts[parts.size()-1];
 }
 
-Slice<u8> readEntireFile(const char* path) {
-	FILE* file = fopen(path, "rb");
-	if (!file) {
-		eprintf(LOG_ERROR_STRING": Failed to open file %s", path);
-		exit(1);
-	}
-	defer(fclose(file));
-
-	fseek(file, 0, SEEK_END);
-	auto const size = ftell(file);
-	fseek(file, 0, SEEK_SET);
-
-	u8* buffer = static_cast<u8*>(malloc(size));
-	assertTrue(buffer != nullptr);
-	fread(buffer, size, 1, file);
-
-	return PtrToSlice(buffer, size);
-}
-
 bool isValidFileNameCharacter(char c) {
 	switch (c) {
 	case '#': case '%': case '&': case '{': case '}': case '<': case '>':
@@ -50,13 +47,21 @@ bool isValidFileNameCharacter(char c) {
 	}
 }
 
-bool isFileAsm(std::string const& filename) {
-	auto const parts = String_View(filename).split('.');
-	auto const& last = parts[parts.size()-1];
-	return 0 == strncmp(last.items, "asm", Min(last.count, 3));
+bool hasExtension(std::string const& filename, const char* extension) {
+	std::string const actual = std::filesystem::path(filename).extension().string();
+	if (actual.size() != strlen(extension)) return false;
+	for (size_t i = 0; i < actual.size(); i++) {
+		if (tolower(cast(u8)actual[i]) != extension[i]) return false;
+	}
+	return true;
+}
+
+// raw: Looking for flat binaries (.bin or .COM images) instead of assembly.
+bool isInputFile(std::string const& filename, bool const raw) {
+	return raw ? (hasExtension(filename, ".bin") || hasExtension(filename, ".com")) : hasExtension(filename, ".asm");
 }
 
-std::vector<std::string> getAllAsmFilesInDir(const char* path) {
+std::vector<std::string> getAllInputFilesInDir(const char* path, bool const raw) {
 	namespace fs = std::filesystem;
 	std::vector<std::string> result = {};
 	if (!fs::exists(path)) {
@@ -69,7 +74,7 @@ std::vector<std::string> getAllAsmFilesInDir(const char* path) {
 	}
 	for (auto const& entry: fs::directory_iterator(path)) {
 		auto const& filename = entry.path().lexically_normal().string();
-		if (entry.is_regular_file() && isFileAsm(filename)) {
+		if (entry.is_regular_file() && isInputFile(filename, raw)) {
 			result.push_back(filename);
 		}
 	}
@@ -87,30 +92,56 @@ bool hasSubString(std::string const& str, const char* substr) {
 	return false;
 }
 
-std::string fuzzyMatch(const char* path, const char* substr) {
-	std::vector<std::string> entries = getAllAsmFilesInDir(path);
+std::string fuzzyMatch(const char* path, const char* substr, bool const raw) {
+	std::vector<std::string> entries = getAllInputFilesInDir(path, raw);
 	for (auto const& entry: entries) {
 		if (hasSubString(entry, substr)) {
 			return entry;
 		}
 	}
-	eprintfln(LOG_ERROR_STRING": Could not find an assembly file in '%s' with the substring '%s'.", path, substr);
+	eprintfln(LOG_ERROR_STRING": Could not find %s in '%s' with the substring '%s'.", raw ? "a .bin or .com file" : "an assembly file", path, substr);
 	exit(1);
 }
 
 void usage(FILE* out, const char* program) {
 	const char* programName = getFileName(program).items;
-	fprintfln(out, "Usage: %s [-exec] [-d <directory>] <substring of *.asm>", programName);
+	fprintfln(out, "Usage: %s [-exec | -run | -jit] [-raw | -stream] [-load <cs>:<ip>] [-j <jobs>] [-d <directory>] <substring of *.asm, or of *.bin/*.com with -raw>", programName);
 	exit(out == stderr ? 1 : 0);
 }
 
+// text: Like 1000:0100, both in hex.
+bool parseLoadAddress(const char* const text, Load_Address& out) {
+	u32 parts[2] = {};
+	const char* at = text;
+	for (int i = 0; i < 2; i++) {
+		if (!isxdigit(cast(u8)*at)) return false;
+		char* end = nullptr;
+		unsigned long const value = strtoul(at, &end, 16);
+		if (value > 0xFFFF || *end != (i == 0 ? ':' : '\0')) return false;
+		parts[i] = cast(u32)value;
+		at = end + 1;
+	}
+	out = {.cs = cast(u16)parts[0], .ip = cast(u16)parts[1]};
+	return true;
+}
+
 struct Cmd_Args {
 	const char* asmFolder = nullptr;
 	const char* asmSubstr = nullptr;
 	bool exec = false;
 	bool test = false;
 	bool dump = false;
+	bool cfg = false; // Also writes the control flow graph to cfg_<name>.dot.
+	bool translate = false; // Also writes the program as C++ to translated_<name>.cpp.
 	bool showClocks = false;
+	bool quiet = false;
+	bool jit = false; // Runs like -run, with the hot blocks compiled.
+	bool noCache = false;
+	bool raw = false; // The inputs are already assembled.
+	bool stream = false; // Decodes raw inputs a chunk at a time instead of all at once.
+	u32 jobs = 0; // 0 unless -j was given, .all and .range then run on that many threads.
+	u32 decodeThreads = 1; // A single file gets the -j threads to decode with instead.
+	Load_Address loadAddress = {}; // Where executing or translating puts the program, 0000:0000 unless -load was given.
 
 	explicit Cmd_Args(int const argc, char** argv) {
 		std::vector<const char*> nonFlags = {};
@@ -121,14 +152,53 @@ struct Cmd_Args {
 				usage(stdout, argv[0]);
 			} else if (0 == strcmp(opt, "-exec")) {
 				exec = true;
+			} else if (0 == strcmp(opt, "-run") || 0 == strcmp(opt, "-quiet")) {
+				quiet = true;
+				exec = true;
+			} else if (0 == strcmp(opt, "-jit")) {
+				jit = true;
+				quiet = true;
+				exec = true;
 			} else if (0 == strcmp(opt, "-test")) {
 				test = true;
+			} else if (0 == strcmp(opt, "-raw")) {
+				raw = true;
+			} else if (0 == strcmp(opt, "-stream")) {
+				stream = true;
+				raw = true;
+			} else if (0 == strcmp(opt, "-nocache")) {
+				noCache = true;
+			} else if (0 == strcmp(opt, "-cfg")) {
+				cfg = true;
+			} else if (0 == strcmp(opt, "-translate")) {
+				translate = true;
 			} else if (0 == strcmp(opt, "-dump")) {
 				dump = true;
 				exec = true;
 			} else if (0 == strcmp(opt, "-showclocks")) {
 				showClocks = true;
 				exec = true;
+			} else if (0 == strcmp(opt, "-j")) {
+				if (arg == nullptr) {
+					usage(stderr, argv[0]);
+				}
+				char* end = nullptr;
+				long const count = strtol(arg, &end, 10);
+				if (*end != '\0' || count < 0) {
+					eprintfln(LOG_ERROR_STRING": Expected a positive number of jobs after '-j', but got '%s'. (0 uses every core)", arg);
+					usage(stderr, argv[0]);
+				}
+				jobs = (count > 0) ? cast(u32)count : Max(1u, std::thread::hardware_concurrency());
+				i++;
+			} else if (0 == strcmp(opt, "-load")) {
+				if (arg == nullptr) {
+					usage(stderr, argv[0]);
+				}
+				if (!parseLoadAddress(arg, loadAddress)) {
+					eprintfln(LOG_ERROR_STRING": Expected a segment and an offset in hex after '-load', like 1000:0100, but got '%s'.", arg);
+					usage(stderr, argv[0]);
+				}
+				i++;
 			} else if (0 == strcmp(opt, "-d")) {
 				if (arg == nullptr) {
 					usage(stderr, argv[0]);
@@ -159,115 +229,212 @@ struct Cmd_Args {
 			eprintfln(LOG_ERROR_STRING": Can not provide the flags '-exec' and '-test' at the same time.");
 			usage(stderr, argv[0]);
 		}
+		if (jit && !JIT_SUPPORTED) {
+			eprintfln(LOG_INFO_STRING": The flag '-jit' needs x86-64, it runs everything with the interpreter here.");
+		}
+		if (stream && (exec || test || cfg || translate)) {
+			eprintfln(LOG_ERROR_STRING": The flag '-stream' only decodes, it can't go with '%s'.",
+				exec ? "-exec" : test ? "-test" : cfg ? "-cfg" : "-translate");
+			usage(stderr, argv[0]);
+		}
 	}
 };
 
-bool runCommand(const char* command, bool const exitIfNotSuccess = true) {
-	printfln(LOG_INFO_STRING": %s", command);
-	int exitCode = system(command);
-	if (exitCode != 0) {
-		if (exitIfNotSuccess) {
-			eprintfln(LOG_ERROR_STRING": Could not execute command '%s'", command);
-			exit(1);
-		} else {
-			return false;
-		}
+// Prints why the source didn't assemble when it doesn't.
+bool assembleSource(const char* name, Slice<u8> const& source, Slice<u8>& outBinary) {
+	Assembler_Error error;
+	if (!assemble(String_View(cast(const char*)source.ptr, source.count), outBinary, error)) {
+		eprintfln(LOG_ERROR_STRING": %s:%u: %s", name, error.line, error.message);
+		return false;
 	}
 	return true;
 }
 
-void deleteFile(const char* path) {
-	const int ok = remove(path);
-	assertTrue(ok == 0);
-	printfln(LOG_INFO_STRING": Deleted file '%s'.", path);
-}
+// For the listings the assembler rejects a line of, like the ones using
+// instructions the decoder doesn't know yet, so they still get decoded as far
+// as they go. outBinary comes from malloc(), same as with assemble().
+bool assembleWithNasm(FILE* out, const char* inputAsmPath, String_View const& name, Slice<u8>& outBinary) {
+	String_Builder tempFileName = string_builder_make();
+	tempFileName.append(".temp86_");
+	tempFileName.append(name);
+	defer(tempFileName.destroy());
 
-void compareFiles(const char* fileA, const char* fileB) {
 	String_Builder command = string_builder_make();
-#if _WIN32
-	const char* compareCmd = "fc /b ";
-#elif __APPLE__
-	const char* compareCmd = "cmp -l ";
-#else
-	const char* compareCmd = "diff --binary ";
-#endif
-	command.append(compareCmd);
-	command.append(fileA);
-	command.append(" ");
-	command.append(fileB);
-
-	if (!runCommand(command.items, false)) {
-		eprintfln(LOG_ERROR_STRING": The files are different!");
-	}
-	command.destroy();
+	command.append("nasm -o ");
+	command.append(tempFileName);
+	command.append(' ');
+	command.append(inputAsmPath);
+	defer(command.destroy());
+
+	fprintfln(out, LOG_INFO_STRING": %s", command.items);
+	if (system(command.items) != 0) {
+		eprintfln(LOG_ERROR_STRING": Could not execute command '%s'", command.items);
+		return false;
+	}
+	defer(remove(tempFileName.items));
+
+	File_Bytes binary;
+	if (!loadFile(tempFileName.items, binary)) {
+		eprintfln(LOG_ERROR_STRING": Could not read '%s': %s", tempFileName.items, strerror(errno));
+		return false;
+	}
+	defer(binary.release());
+	size_t const count = binary.bytes.count;
+	u8* buffer = count == 0 ? nullptr : cast(u8*)malloc(count);
+	if (count != 0) {
+		assertTrue(buffer != nullptr);
+		memcpy(buffer, binary.bytes.ptr, count);
+	}
+	outBinary = PtrToSlice(buffer, count);
+	return true;
+}
+
+// what: Where the bytes came from, e.g. "Encoding the decoded instructions".
+bool compareRoundTrip(FILE* out, const char* what, Slice<u8> const& expected, Slice<u8> const& actual) {
+	size_t const count = Min(expected.count, actual.count);
+	size_t offset = 0;
+	while (offset < count && expected.ptr[offset] == actual.ptr[offset]) {
+		offset++;
+	}
+	if (offset == count && expected.count == actual.count) {
+		fprintfln(out, LOG_INFO_STRING": %s gives back the same %zu bytes.", what, expected.count);
+		return true;
+	}
+	if (offset == count) {
+		eprintfln(LOG_ERROR_STRING": %s gives back %zu bytes instead of %zu, the first %zu match.", what, actual.count, expected.count, count);
+	} else {
+		eprintfln(LOG_ERROR_STRING": %s gives back different bytes, the first difference is at offset %zu (0x%02X instead of 0x%02X).",
+			what, offset, actual.ptr[offset], expected.ptr[offset]);
+	}
+	return false;
+}
+
+// Checks that the length pre-pass finds the instructions the decoder decoded.
+bool compareOffsets(FILE* out, Instruction_Stream const& stream, Instruction_Offsets const& offsets) {
+	size_t const count = Min(stream.items.size(), offsets.items.size());
+	size_t i = 0;
+	while (i < count && stream.items[i].offset == offsets.items[i]) {
+		i++;
+	}
+	if (i == count && stream.items.size() == offsets.items.size()) {
+		fprintfln(out, LOG_INFO_STRING": Finding the instruction lengths gives back the same %zu offsets.", count);
+		return true;
+	}
+	if (i == count) {
+		eprintfln(LOG_ERROR_STRING": Finding the instruction lengths gives back %zu offsets instead of %zu, the first %zu match.",
+			offsets.items.size(), stream.items.size(), count);
+	} else {
+		eprintfln(LOG_ERROR_STRING": Finding the instruction lengths gives back different offsets, instruction %zu is at %u instead of %u.",
+			i, offsets.items[i], stream.items[i].offset);
+	}
+	return false;
 }
 
-void printProcessingHeader(const char* path) {
+void printProcessingHeader(FILE* out, const char* path) {
 	String_Builder header = string_builder_make();
 	defer(header.destroy());
 	header.append(ASCII_COLOR_B_GREEN "Processing" ASCII_COLOR_END " file ");
 	header.append(ASCII_COLOR_B_CYAN);
 	header.append(path);
 	header.append(ASCII_COLOR_END"\n");
-	printf(header.items);
+	fputs(header.items, out);
 	size_t const actualHeaderLen = header.len - ASCII_COLOR_byteCount(header.items) - StrLen("\n");
 	for (size_t i = 0; i < actualHeaderLen; i++) {
-		putchar('-');
+		fputc('-', out);
 	}
-	putchar('\n');
+	fputc('\n', out);
 }
 
-void processAsm(Cmd_Args const& cmdArgs, const char* inputAsmPath) {
-	printProcessingHeader(inputAsmPath);
-	FILE* inputAsm = fopen(inputAsmPath, "r");
-	if (inputAsm == nullptr) {
-		eprintfln("Could not load file '%s'", inputAsmPath);
-		exit(1);
-	}
-	defer(fclose(inputAsm));
+enum struct Job_Status : u8 { Ok, Failed, Mismatch };
+constexpr const char* Job_Status_Names[] = { "ok", "failed", "mismatch" };
+
+struct Job_Result {
+	Job_Status status;
+	u64 clocks;
+	f64 seconds;
+};
+
+// out: Where everything goes except the errors.
+Job_Result processAsm(Cmd_Args const& cmdArgs, const char* inputAsmPath, FILE* out) {
+	auto const start = std::chrono::high_resolution_clock::now();
+	Job_Result result = {};
+	printProcessingHeader(out, inputAsmPath);
 
 	String_View const inputAsmFileName = getFileName(inputAsmPath);
+	const char* const extension = strrchr(inputAsmFileName.items, '.');
 	auto const validInputAsmName = String_View{
 		inputAsmFileName.items,
-		inputAsmFileName.count - StrLen(".asm"),
+		extension ? cast(size_t)(extension - inputAsmFileName.items) : inputAsmFileName.count,
 	};
 
-	String_Builder tempFileName = string_builder_make();
-	tempFileName.append(".temp86_");
-	tempFileName.append(validInputAsmName);
-	defer(tempFileName.destroy());
-
-	/* Compiling the input assembly file into a binary. */ {
-		String_Builder command = string_builder_make();
-		command.append("nasm -o ");
-		command.append(tempFileName);
-		command.append(' ');
-		command.append(inputAsmPath);
-		runCommand(command.items);
-		command.destroy();
+	if (cmdArgs.stream) {
+		FILE* const inputFile = fopen(inputAsmPath, "rb");
+		if (inputFile == nullptr) {
+			eprintfln(LOG_ERROR_STRING": Could not read '%s': %s", inputAsmPath, strerror(errno));
+			result.status = Job_Status::Failed;
+			return result;
+		}
+		defer(fclose(inputFile));
+		fprintfln(out, ASCII_COLOR_GREEN "; %s" ASCII_COLOR_END, inputAsmFileName.items);
+		result.status = decodeStream(inputFile, out, cmdArgs.showClocks) ? Job_Status::Ok : Job_Status::Failed;
+		fputc('\n', out);
+		std::chrono::duration<f64> const elapsed = std::chrono::high_resolution_clock::now() - start;
+		result.seconds = elapsed.count();
+		return result;
 	}
-	defer(deleteFile(tempFileName.items));
-
-	FILE* tempFile = fopen(tempFileName.items, "rb");
-	assertTrue(tempFile != nullptr);
-	defer(fclose(tempFile));
 
-	Slice<u8> inputBinary = readEntireFile(tempFileName.items);
-	defer(free(inputBinary.ptr));
+	File_Bytes inputFile;
+	if (!loadFile(inputAsmPath, inputFile)) {
+		eprintfln(LOG_ERROR_STRING": Could not read '%s': %s", inputAsmPath, strerror(errno));
+		result.status = Job_Status::Failed;
+		return result;
+	}
+	defer(inputFile.release());
+
+	// With -raw the file already is the program, .COM images included, since
+	// they're flat binaries too.
+	Slice<u8> inputBinary = inputFile.bytes;
+	if (!cmdArgs.raw) {
+		Slice<u8> const& inputAsm = inputFile.bytes;
+		bool const cached = !cmdArgs.noCache && loadCachedBinary(inputAsm, inputBinary);
+		if (!cached) {
+			Assembler_Error error;
+			if (!assemble(String_View(cast(const char*)inputAsm.ptr, inputAsm.count), inputBinary, error)) {
+				fprintfln(out, LOG_INFO_STRING": %s:%u: %s Trying nasm instead.", inputAsmPath, error.line, error.message);
+				if (!assembleWithNasm(out, inputAsmPath, validInputAsmName, inputBinary)) {
+					result.status = Job_Status::Failed;
+					return result;
+				}
+			}
+			if (!cmdArgs.noCache) {
+				storeCachedBinary(inputAsm, inputBinary);
+			}
+		}
+		if (cached) {
+			fprintfln(out, LOG_INFO_STRING": Loaded %s from " BINARY_CACHE_FOLDER " (%zu bytes).", inputAsmPath, inputBinary.count);
+		} else {
+			fprintfln(out, LOG_INFO_STRING": Assembled %s into %zu bytes.", inputAsmPath, inputBinary.count);
+		}
+	}
+	defer(if (!cmdArgs.raw) free(inputBinary.ptr));
 
 	if (cmdArgs.exec) {
-		printfln("--- %s execution ---", inputAsmFileName.items);
+		fprintfln(out, "--- %s execution ---", inputAsmFileName.items);
 	} else {
-		printfln(ASCII_COLOR_GREEN "; %s" ASCII_COLOR_END, inputAsmFileName.items);
+		fprintfln(out, ASCII_COLOR_GREEN "; %s" ASCII_COLOR_END, inputAsmFileName.items);
 	}
-	bool const couldDecode = decodeOrSimulate(stdout, inputBinary, cmdArgs.exec, cmdArgs.showClocks);
-	putchar('\n');
+	std::unique_ptr<Machine> const machine = std::make_unique<Machine>();
+	Simulation_Stats stats = {};
+	bool const couldDecode = decodeOrSimulate(out, *machine, inputBinary, cmdArgs.exec, cmdArgs.showClocks, cmdArgs.quiet, &stats, cmdArgs.decodeThreads, cmdArgs.jit, cmdArgs.loadAddress);
+	fputc('\n', out);
+	result.status = couldDecode ? Job_Status::Ok : Job_Status::Failed;
+	result.clocks = stats.clocks;
 
 	if (couldDecode && cmdArgs.dump) {
 		assertTrue(cmdArgs.exec);
 		size_t lastByteIndex = 0;
-		for (size_t i = 0; i < StaticArrayCount(gMemory); i++) {
-			if (gMemory[i] != 0) {
+		for (size_t i = 0; i < StaticArrayCount(machine->memory); i++) {
+			if (machine->memory[i] != 0) {
 				lastByteIndex = i;
 			}
 		}
@@ -277,41 +444,180 @@ void processAsm(Cmd_Args const& cmdArgs, const char* inputAsmPath) {
 			dumpName.append(validInputAsmName);
 			defer(dumpName.destroy());
 			FILE* dumpFile = fopen(dumpName.items, "wb");
-			fwrite(gMemory, lastByteIndex, sizeof(u8), dumpFile);
+			fwrite(machine->memory, lastByteIndex, sizeof(u8), dumpFile);
 			fclose(dumpFile);
-			printfln(LOG_INFO_STRING": Created file '%s'", dumpName.items);
+			fprintfln(out, LOG_INFO_STRING": Created file '%s'", dumpName.items);
+		}
+	}
+
+	if (couldDecode && cmdArgs.cfg) {
+		Instruction_Stream stream;
+		bool const decoded = decodeProgram(inputBinary, stream);
+		Control_Flow_Graph cfg;
+		if (decoded) buildControlFlowGraph(stream, cfg);
+
+		String_Builder cfgName = string_builder_make();
+		cfgName.append("cfg_");
+		cfgName.append(validInputAsmName);
+		cfgName.append(".dot");
+		defer(cfgName.destroy());
+		// Running it only decodes what gets reached, the graph needs every byte to decode.
+		FILE* cfgFile = decoded ? fopen(cfgName.items, "w") : nullptr;
+		if (!decoded && stream.truncated) {
+			eprintfln(LOG_ERROR_STRING": Could not create '%s', the instruction at offset %" PRIi64 " of %s is cut off by the end.", cfgName.items, stream.unrecognizedOffset, inputAsmPath);
+			result.status = Job_Status::Failed;
+		} else if (!decoded) {
+			eprintfln(LOG_ERROR_STRING": Could not create '%s', the byte at offset %" PRIi64 " of %s doesn't decode.", cfgName.items, stream.unrecognizedOffset, inputAsmPath);
+			result.status = Job_Status::Failed;
+		} else if (cfgFile == nullptr) {
+			eprintfln(LOG_ERROR_STRING": Could not create '%s': %s", cfgName.items, strerror(errno));
+			result.status = Job_Status::Failed;
+		} else {
+			printControlFlowGraphDot(cfgFile, stream, cfg);
+			fclose(cfgFile);
+			fprintfln(out, LOG_INFO_STRING": Created file '%s' (%zu blocks)", cfgName.items, cfg.blocks.size());
+		}
+	}
+
+	if (couldDecode && cmdArgs.translate) {
+		Instruction_Stream stream;
+		bool const decoded = decodeProgram(inputBinary, stream);
+		Control_Flow_Graph cfg;
+		if (decoded) buildControlFlowGraph(stream, cfg);
+
+		String_Builder translatedName = string_builder_make();
+		translatedName.append("translated_");
+		translatedName.append(validInputAsmName);
+		translatedName.append(".cpp");
+		defer(translatedName.destroy());
+		FILE* translatedFile = decoded ? fopen(translatedName.items, "w") : nullptr;
+		if (!decoded && stream.truncated) {
+			eprintfln(LOG_ERROR_STRING": Could not create '%s', the instruction at offset %" PRIi64 " of %s is cut off by the end.", translatedName.items, stream.unrecognizedOffset, inputAsmPath);
+			result.status = Job_Status::Failed;
+		} else if (!decoded) {
+			eprintfln(LOG_ERROR_STRING": Could not create '%s', the byte at offset %" PRIi64 " of %s doesn't decode.", translatedName.items, stream.unrecognizedOffset, inputAsmPath);
+			result.status = Job_Status::Failed;
+		} else if (translatedFile == nullptr) {
+			eprintfln(LOG_ERROR_STRING": Could not create '%s': %s", translatedName.items, strerror(errno));
+			result.status = Job_Status::Failed;
+		} else {
+			bool const translated = translateProgram(translatedFile, inputBinary, stream, cfg, cmdArgs.loadAddress, inputAsmFileName.items);
+			fclose(translatedFile);
+			if (translated) {
+				fprintfln(out, LOG_INFO_STRING": Created file '%s' (%zu blocks)", translatedName.items, cfg.blocks.size());
+			} else {
+				remove(translatedName.items);
+				result.status = Job_Status::Failed;
+			}
 		}
 	}
 
 	if (couldDecode && cmdArgs.test) {
 		assertTrue(cmdArgs.exec == false);
-		String_Builder decodedAsmBinaryFileName = string_builder_make();
-		decodedAsmBinaryFileName.append(".temp86_out_");
-		decodedAsmBinaryFileName.append(validInputAsmName);
-		defer(decodedAsmBinaryFileName.destroy());
-
-		String_Builder decodedAsmTextFileName = decodedAsmBinaryFileName.copy();
-		decodedAsmTextFileName.append(".asm");
-		defer(decodedAsmTextFileName.destroy());
-
-		FILE* decodedAsmTextFile = fopen(decodedAsmTextFileName.items, "w");
-		assertTrue(decodedAsmTextFile != nullptr);
-		decodeOrSimulate(decodedAsmTextFile, inputBinary, false, false);
-		fclose(decodedAsmTextFile);
-		printfln(LOG_INFO_STRING": Created %s", decodedAsmTextFileName.items);
-		defer(deleteFile(decodedAsmTextFileName.items));
-
-		String_Builder command = string_builder_make();
-		command.append("nasm -o ");
-		command.append(decodedAsmBinaryFileName);
-		command.append(' ');
-		command.append(decodedAsmTextFileName);
-		runCommand(command.items);
-		command.destroy();
-		defer(deleteFile(decodedAsmBinaryFileName.items));
-
-		compareFiles(tempFileName.items, decodedAsmBinaryFileName.items);
+		Instruction_Stream stream;
+		bool const decoded = decodeProgram(inputBinary, stream);
+		assertTrue(decoded);
+		Instruction_Offsets offsets;
+		findInstructionOffsets(inputBinary, offsets);
+		if (!compareOffsets(out, stream, offsets)) {
+			result.status = Job_Status::Mismatch;
+		}
+
+		std::vector<u8> encodedBinary;
+		encodeProgram(stream, encodedBinary);
+		if (!compareRoundTrip(out, "Encoding the decoded instructions", inputBinary, StdVectorToSlice(encodedBinary))) {
+			result.status = Job_Status::Mismatch;
+		}
+
+		// Also checks that the printed assembly means the same thing.
+		FILE* decodedAsmFile = tmpfile();
+		assertTrue(decodedAsmFile != nullptr);
+		decodeOrSimulate(decodedAsmFile, *machine, inputBinary, false, false, false);
+		rewind(decodedAsmFile);
+		File_Bytes decodedAsmBytes;
+		bool const couldRead = readStream(decodedAsmFile, decodedAsmBytes);
+		fclose(decodedAsmFile);
+		assertTrue(couldRead);
+		defer(decodedAsmBytes.release());
+		Slice<u8> const& decodedAsm = decodedAsmBytes.bytes;
+
+		Slice<u8> decodedBinary;
+		if (!assembleSource("<decoded>", decodedAsm, decodedBinary)) {
+			result.status = Job_Status::Mismatch;
+		} else {
+			defer(free(decodedBinary.ptr));
+			if (!compareRoundTrip(out, "Assembling the decoded assembly", inputBinary, decodedBinary)) {
+				result.status = Job_Status::Mismatch;
+			}
+		}
 	}
+
+	std::chrono::duration<f64> const elapsed = std::chrono::high_resolution_clock::now() - start;
+	result.seconds = elapsed.count();
+	return result;
+}
+
+// Runs the listings on cmdArgs.jobs threads. Each one prints into its own
+// temporary file, which gets copied to stdout in the order of the paths as
+// soon as the ones before it are done, then a summary of every listing.
+void processAsmBatch(Cmd_Args const& cmdArgs, std::vector<std::string> const& paths) {
+	struct Job {
+		FILE* output;
+		Job_Result result;
+		bool done;
+	};
+	std::vector<Job> jobs(paths.size());
+	std::atomic<size_t> nextJob = 0;
+	std::mutex mutex;
+	std::condition_variable jobDone;
+	auto const start = std::chrono::high_resolution_clock::now();
+
+	auto const worker = [&]() {
+		for (size_t i = nextJob++; i < paths.size(); i = nextJob++) {
+			FILE* output = tmpfile();
+			assertTrue(output != nullptr);
+			Job_Result const result = processAsm(cmdArgs, paths[i].c_str(), output);
+			fprintf(output, "\n\n\n");
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs[i] = {.output = output, .result = result, .done = true};
+			jobDone.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	u32 const threadCount = Min(cmdArgs.jobs, cast(u32)paths.size());
+	for (u32 i = 0; i < threadCount; i++) {
+		threads.emplace_back(worker);
+	}
+
+	for (Job& job: jobs) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobDone.wait(lock, [&]() { return job.done; });
+		}
+		rewind(job.output);
+		char buffer[4096];
+		for (size_t n; (n = fread(buffer, 1, sizeof(buffer), job.output)) > 0;) {
+			fwrite(buffer, 1, n, stdout);
+		}
+		fclose(job.output);
+	}
+	for (std::thread& thread: threads) {
+		thread.join();
+	}
+	std::chrono::duration<f64> const elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	size_t failed = 0;
+	printfln("Summary (%zu files, %u jobs):", paths.size(), cmdArgs.jobs);
+	printfln("  %-8s %12s %10s  %s", "Status", "Clocks", "Time (s)", "File");
+	for (size_t i = 0; i < paths.size(); i++) {
+		Job_Result const& result = jobs[i].result;
+		if (result.status != Job_Status::Ok) failed++;
+		printfln("  %-8s %12" PRIu64 " %10.4f  %s",
+			Job_Status_Names[static_cast<u8>(result.status)],
+			result.clocks, result.seconds, paths[i].c_str());
+	}
+	printfln("%zu ok, %zu failed, %.4f s wall time.", paths.size() - failed, failed, elapsed.count());
 }
 
 int main(int const argc, char **argv) {
@@ -321,10 +627,14 @@ int main(int const argc, char **argv) {
 	Cmd_Args cmdArgs(argc, argv);
 
 	if (0 == strcmp(cmdArgs.asmSubstr, ".all")) {
-		auto const asmFiles = getAllAsmFilesInDir(cmdArgs.asmFolder);
-		for (auto const& file: asmFiles) {
-			processAsm(cmdArgs, file.c_str());
-			printf("\n\n\n");
+		auto const asmFiles = getAllInputFilesInDir(cmdArgs.asmFolder, cmdArgs.raw);
+		if (cmdArgs.jobs > 0) {
+			processAsmBatch(cmdArgs, asmFiles);
+		} else {
+			for (auto const& file: asmFiles) {
+				processAsm(cmdArgs, file.c_str(), stdout);
+				printf("\n\n\n");
+			}
 		}
 	} else if (0 == strncmp(cmdArgs.asmSubstr, ".range", StrLen(".range"))) {
 		String_View range(cmdArgs.asmSubstr + StrLen(".range"));
@@ -349,15 +659,23 @@ int main(int const argc, char **argv) {
 		if (range.count != 0) {
 			eprintfln(LOG_ERROR_STRING": The format is `.range:a:b` (inclusive) where a and b are 32-bit positive signed integers.");
 		}
+		std::vector<std::string> matches;
 		for (i32 i = from; i <= to; i++) {
 			char it[I32_STR_SIZE_BASE10] = {0};
 			snprintf(it, sizeof(it), "%" PRIi32, i);
-            std::string const match = fuzzyMatch(cmdArgs.asmFolder, it);
-            processAsm(cmdArgs, match.c_str());
+            matches.push_back(fuzzyMatch(cmdArgs.asmFolder, it, cmdArgs.raw));
+		}
+		if (cmdArgs.jobs > 0) {
+			processAsmBatch(cmdArgs, matches);
+		} else {
+			for (auto const& match: matches) {
+				processAsm(cmdArgs, match.c_str(), stdout);
+			}
 		}
 	} else {
-		std::string const match = fuzzyMatch(cmdArgs.asmFolder, cmdArgs.asmSubstr);
-		processAsm(cmdArgs, match.c_str());
+		cmdArgs.decodeThreads = Max(1u, cmdArgs.jobs);
+		std::string const match = fuzzyMatch(cmdArgs.asmFolder, cmdArgs.asmSubstr, cmdArgs.raw);
+		processAsm(cmdArgs, match.c_str(), stdout);
 	}
 
 	return 0;
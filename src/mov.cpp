@@ -1,35 +1,34 @@
 #include "mov.h"
 #include "string_builder.h"
 
-bool isByte_MOV(u8 const byte) {
-	bool const result = (byte >> 2 == 0b100010)  ||
-						(byte >> 1 == 0b1100011) ||
-						(byte >> 4 == 0b1011)    ||
-						(byte >> 2 == 0b101000)  ||
-						(byte == 0b10001110 || byte == 0b10001100);
-	return result;
-}
-
-void exec_MOV(Decoder_Context const& decoder, Instruction const& inst) {
+void exec_MOV(Machine& machine, Decoder_Context& decoder, Instruction const& inst, Exec_Trace& trace) {
+	Unused(decoder);
     if (IsBinaryInstTypeOrderValid(inst)) {
-    	String_Builder dstName = getInstOpName(inst.dst);
-    	defer(dstName.destroy());
-
-        u16 const oldValue = getInstOpValue(inst.dst);
-        u16 const newValue = getInstOpValue(inst.src);
-        setInstOpValue(inst.dst, newValue);
-        decoder.print("%s:0x%x->0x%x ", dstName.items, oldValue, newValue);
-        decoder.printlnIP();
+    	if (IsOperandMem(inst.dst)) {
+    		trace.dstAddress = EffectiveAddress::getInnerValue(machine, inst.dst.address);
+    	}
+
+    	u16 const mask = (IsOperandReg16(inst.dst) || IsOperandMem16(inst.dst)) ? 0xFFFF : 0xFF;
+        u16 const oldValue = getInstOpValue(machine, inst.dst);
+        u16 const newValue = getInstOpValue(machine, inst.src) & mask;
+        setInstOpValue(machine, inst.dst, newValue);
+    	trace.kind = Exec_Trace_Kind::Write;
+    	trace.oldValue = oldValue;
+    	trace.newValue = newValue;
 	} else {
-		decoder.println(ErrorComment_InvalidInstructionTypeOrder(inst));
+		trace.kind = Exec_Trace_Kind::InvalidOperands;
 	}
 }
 
-void decode_MOV(Decoder_Context& decoder, u8& byte) {
-	Instruction inst = { .type = Inst_mov };
+Decoded_Instruction decode_MOV(Decoder_Context& decoder, u8& byte, Opcode_Entry const& entry) {
+	Decoded_Instruction decoded = {};
+	Instruction& inst = decoded.inst;
+	Decoded_Fields& fields = decoded.fields;
+	inst.type = Inst_mov;
 
+	switch (entry.form) {
 	// MOV: 1. Register/memory to/from register.
-	if (byte >> 2 == 0b100010) {
+	case Mov_RegMemToFromReg: {
 		bool const D = (byte >> 1) & 1;
 		bool const W = (byte)      & 1;
 
@@ -54,18 +53,13 @@ void decode_MOV(Decoder_Context& decoder, u8& byte) {
 			SwapInstructionOperands(inst);
 		}
 
-		decoder.printInst(inst);
-		if (!decoder.exec) {
-            decoder.print("(D:%d, W:%d, ", D, W);
-            decoder.printMOD(MOD, ' ');
-            decoder.printREG(REG, ' ');
-            decoder.printR_M(R_M, ')');
-            decoder.print(" <- ");
-            decoder.printByteStack();
-		}
-	}
+		fields = {
+			.layout = Decode_Layout::D_W_MOD_REG_RM,
+			.MOD = MOD, .REG = REG, .R_M = R_M, .D = D, .W = W,
+		};
+	} break;
 	// MOV: 2. Immediate to register/memory.
-	else if (byte >> 1 == 0b1100011) {
+	case Mov_ImmToRegMem: {
 		bool const W = byte & 1;
 
 		decoder.advance(byte);
@@ -85,17 +79,13 @@ void decode_MOV(Decoder_Context& decoder, u8& byte) {
 			inst.dst = InstOpEffectiveAddress(MOD, R_M, W, displacement);
 		}
 
-		decoder.printInst(inst);
-		if (!decoder.exec) {
-            decoder.print("(W:%d, ", W);
-            decoder.printMOD(MOD, ' ');
-            decoder.printR_M(R_M, ')');
-            decoder.print(" <- ");
-            decoder.printByteStack();
-		}
-	}
+		fields = {
+			.layout = Decode_Layout::W_MOD_RM,
+			.MOD = MOD, .R_M = R_M, .W = W,
+		};
+	} break;
 	// MOV: 3. Immediate to register.
-	else if (byte >> 4 == 0b1011) {
+	case Mov_ImmToReg: {
 		bool const W = (byte >> 3) & 1;
 		u8 const REG = byte & 0b111;
 		assertTrue(is_REG_Valid(REG));
@@ -105,39 +95,33 @@ void decode_MOV(Decoder_Context& decoder, u8& byte) {
 		inst.dst = REG_Table[REG][W];
 		inst.src = InstOpImmediate(W, data);
 
-		decoder.printInst(inst);
-		if (!decoder.exec) {
-            decoder.print("(W:%d, ", W);
-            decoder.printREG(REG, ' ');
-            decoder.print(" <- ");
-            decoder.printByteStack();
-		}
-	}
+		fields = {
+			.layout = Decode_Layout::W_REG,
+			.REG = REG, .W = W,
+		};
+	} break;
 	// MOV: 4. Memory to accumulator or Accumulator to memory.
-	else if (byte >> 2 == 0b101000) {
+	case Mov_MemToFromAcc: {
 		bool const D = (byte >> 1) & 1;
 		bool const W = byte & 1;
 
 		i16 const address = signExtendWord(decoder.advance16Bits(byte));
 
 		// (D = 0) The address is the source.
-		const char* description = "Memory to accumulator";
 		inst.src = InstOpEffectiveAddressDirectWord(W, address);
 		inst.dst = REG_Table[0b000][W];
 
 		if (D) { // (D = 1) The address is the destination.
-			description = "Accumulator to memory";
 			SwapInstructionOperands(inst);
 		}
 
-		decoder.printInst(inst);
-		if (!decoder.exec) {
-            decoder.print("(%s, W:%d) <- ", description, W);
-            decoder.printByteStack();
-		}
-	}
+		fields = {
+			.layout = Decode_Layout::Accumulator,
+			.D = D, .W = W,
+		};
+	} break;
 	// MOV: 5. Register/memory to segment register (Or vice versa)
-	else if (byte == 0b10001110 || byte == 0b10001100) {
+	case Mov_RegMemToFromSegment: {
 		bool const D = (byte >> 1) & 1;
 
 		decoder.advance(byte);
@@ -161,20 +145,12 @@ void decode_MOV(Decoder_Context& decoder, u8& byte) {
 			SwapInstructionOperands(inst);
 		}
 
-		decoder.printInst(inst);
-		if (!decoder.exec) {
-            decoder.print("(D:%d, ", D);
-            decoder.printMOD(MOD, ' ');
-            decoder.printSR(SR, ' ');
-            decoder.printR_M(R_M, ')');
-            decoder.print(" <- ");
-            decoder.printByteStack();
-		}
-	} else {
-		unreachable();
+		fields = {
+			.layout = Decode_Layout::D_MOD_SR_RM,
+			.MOD = MOD, .REG = SR, .R_M = R_M, .D = D,
+		};
+	} break;
+	default: unreachable();
 	}
-
-    if (decoder.exec) {
-    	exec_MOV(decoder, inst);
-    }
+	return decoded;
 }
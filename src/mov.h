@@ -1,6 +1,25 @@
 #pragma once
 
 #include "decoder.h"
+#include "opcode_table.h"
 
-bool isByte_MOV(u8 byte);
-void decode_MOV(Decoder_Context& decoder, u8& byte);
+enum Mov_Form : u8 {
+	Mov_None = 0,
+	Mov_RegMemToFromReg,      // 100010dw
+	Mov_ImmToRegMem,          // 1100011w
+	Mov_ImmToReg,             // 1011wreg
+	Mov_MemToFromAcc,         // 101000dw
+	Mov_RegMemToFromSegment,  // 100011d0
+};
+
+constexpr Mov_Form getMovForm(u8 const byte) {
+	if (byte >> 2 == 0b100010)  return Mov_RegMemToFromReg;
+	if (byte >> 1 == 0b1100011) return Mov_ImmToRegMem;
+	if (byte >> 4 == 0b1011)    return Mov_ImmToReg;
+	if (byte >> 2 == 0b101000)  return Mov_MemToFromAcc;
+	if (byte == 0b10001110 || byte == 0b10001100) return Mov_RegMemToFromSegment;
+	return Mov_None;
+}
+
+Decoded_Instruction decode_MOV(Decoder_Context& decoder, u8& byte, Opcode_Entry const& entry);
+void exec_MOV(Machine& machine, Decoder_Context& decoder, Instruction const& inst, Exec_Trace& trace);
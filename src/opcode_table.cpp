@@ -0,0 +1,142 @@
+#include "opcode_table.h"
+
+#include "mov.h"
+#include "jumps.h"
+#include "common_instructions.h"
+
+// Same priority the decoder always had: mov, then jumps, then formatList in order.
+static constexpr Opcode_Entry classifyOpcode(u8 const byte, u8 const REG) {
+	if (Mov_Form const form = getMovForm(byte); form != Mov_None) {
+		return Opcode_Entry{ .decode = decode_MOV, .exec = exec_MOV, .type = Inst_mov, .form = form };
+	}
+	if (Instruction_Type const type = jumpTypeFromByte(byte); type != Inst_None) {
+		return Opcode_Entry{ .decode = decode_Jump, .exec = exec_Jump, .type = type };
+	}
+	for (u8 i = 0; i < StaticArrayCount(formatList); i++) {
+		if (i8 const variant = matchCommonFormat(formatList[i], byte, REG); variant != -1) {
+			return Opcode_Entry{
+				.decode = decode_common_inst,
+				.exec = exec_common_inst,
+				.type = formatList[i].type,
+				.form = i,
+				.variant = formatList[i].hasOnlyOneVariant ? cast(i8)-1 : variant,
+			};
+		}
+	}
+	return Opcode_Entry{};
+}
+
+static constexpr Opcode_Table makeOpcodeTable() {
+	Opcode_Table table = {};
+	for (u32 byte = 0; byte < 256; byte++) {
+		for (u8 REG = 0; REG < 8; REG++) {
+			table.extended[byte][REG] = classifyOpcode(byte, REG);
+			if (table.extended[byte][REG] != table.extended[byte][0]) {
+				table.hasRegExtension[byte] = true;
+			}
+		}
+		table.primary[byte] = table.extended[byte][0];
+	}
+	return table;
+}
+
+constexpr Opcode_Table gOpcodeTable = makeOpcodeTable();
+
+// Which layout the decode proc of an entry fills Decoded_Fields with.
+static constexpr Decode_Layout getEntryLayout(Opcode_Entry const& entry) {
+	if (entry.type == Inst_mov) {
+		switch (entry.form) {
+			case Mov_RegMemToFromReg:     return Decode_Layout::D_W_MOD_REG_RM;
+			case Mov_ImmToRegMem:         return Decode_Layout::W_MOD_RM;
+			case Mov_ImmToReg:            return Decode_Layout::W_REG;
+			case Mov_MemToFromAcc:        return Decode_Layout::Accumulator;
+			case Mov_RegMemToFromSegment: return Decode_Layout::D_MOD_SR_RM;
+			default: unreachable();
+		}
+	}
+	if (IsInstJump(entry.type)) {
+		return Decode_Layout::Jump;
+	}
+	switch (entry.variant) {
+		case -1: return Decode_Layout::V_W_MOD_REG_RM;
+		case 0:  return Decode_Layout::D_W_MOD_REG_RM;
+		case 1:  return Decode_Layout::W_MOD_RM;
+		case 2:  return Decode_Layout::W;
+		default: unreachable();
+	}
+}
+
+static constexpr Opcode_Encoding_Table makeOpcodeEncodingTable() {
+	Opcode_Encoding_Table table = {};
+	for (i32 byte = 255; byte >= 0; byte--) {
+		for (i32 REG = 7; REG >= 0; REG--) {
+			Opcode_Entry const& entry = gOpcodeTable.extended[byte][REG];
+			if (entry.type == Inst_None) continue;
+			u8 const layout = static_cast<u8>(getEntryLayout(entry));
+			table.entries[entry.type][layout] = Opcode_Encoding{.byte = cast(u8)byte, .REG = cast(u8)REG, .valid = true};
+		}
+	}
+	return table;
+}
+
+constexpr Opcode_Encoding_Table gOpcodeEncodings = makeOpcodeEncodingTable();
+
+// Follows what the decode procs advance through.
+static constexpr u8 getEntryLength(u8 const byte, Opcode_Entry const& entry) {
+	bool const W = byte & 1;
+	bool const S = (byte >> 1) & 1;
+	if (entry.type == Inst_None) {
+		return 0;
+	}
+	if (entry.type == Inst_mov) {
+		switch (entry.form) {
+			case Mov_RegMemToFromReg:     return 2 | OPCODE_LENGTH_MODRM;
+			case Mov_ImmToRegMem:         return (2 + 1 + W) | OPCODE_LENGTH_MODRM;
+			case Mov_ImmToReg:            return 1 + 1 + ((byte >> 3) & 1);
+			case Mov_MemToFromAcc:        return 3;
+			case Mov_RegMemToFromSegment: return 2 | OPCODE_LENGTH_MODRM;
+			default: unreachable();
+		}
+	}
+	if (IsInstJump(entry.type)) {
+		return 2;
+	}
+	Common_Format const& format = formatList[entry.form];
+	switch (entry.variant) {
+		case -1: return 2 | OPCODE_LENGTH_MODRM;
+		case 0:  return 2 | OPCODE_LENGTH_MODRM;
+		case 1: {
+			bool const wide = format.three.has_S_on_fmt1 ? (!S && W) : W;
+			return (2 + 1 + wide) | OPCODE_LENGTH_MODRM;
+		}
+		case 2:  return 1 + 1 + W;
+		default: unreachable();
+	}
+}
+
+static constexpr Opcode_Length_Table makeOpcodeLengthTable() {
+	Opcode_Length_Table table = {};
+	for (u32 byte = 0; byte < 256; byte++) {
+		for (u8 REG = 0; REG < 8; REG++) {
+			table.extended[byte][REG] = getEntryLength(byte, gOpcodeTable.extended[byte][REG]);
+		}
+		table.primary[byte] = table.extended[byte][0];
+		if (gOpcodeTable.hasRegExtension[byte]) {
+			table.primary[byte] |= OPCODE_LENGTH_EXTENDED;
+		}
+	}
+	return table;
+}
+
+constexpr Opcode_Length_Table gOpcodeLengths = makeOpcodeLengthTable();
+
+static_assert(gOpcodeTable.primary[0b10001001].type == Inst_mov);
+static_assert(gOpcodeTable.primary[0b01110101].type == Inst_jne);
+static_assert(gOpcodeTable.hasRegExtension[0b10000011]);
+static_assert(gOpcodeTable.extended[0b10000011][0b101].type == Inst_sub);
+static_assert(gOpcodeTable.extended[0b11110111][0b100].type == Inst_mul);
+static_assert(gOpcodeEncodings.entries[Inst_mov][static_cast<u8>(Decode_Layout::W_REG)].byte == 0b10110000);
+static_assert(gOpcodeEncodings.entries[Inst_sub][static_cast<u8>(Decode_Layout::W_MOD_RM)].REG == 0b101);
+static_assert(gOpcodeLengths.primary[0b10000001] == (4 | OPCODE_LENGTH_MODRM | OPCODE_LENGTH_EXTENDED));
+static_assert(gOpcodeLengths.extended[0b11110111][0b000] == (4 | OPCODE_LENGTH_MODRM));
+static_assert(gOpcodeLengths.extended[0b11110111][0b100] == (2 | OPCODE_LENGTH_MODRM));
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "decoder.h"
+#include "instruction_stream.h"
+
+struct Opcode_Entry;
+typedef Decoded_Instruction (*Decode_Proc)(Decoder_Context& decoder, u8& byte, Opcode_Entry const& entry);
+typedef void (*Exec_Proc)(Machine& machine, Decoder_Context& decoder, Instruction const& inst, Exec_Trace& trace);
+
+// What the first byte of an instruction (and, for the group opcodes, the REG
+// field of its ModRM byte) says about how to decode it.
+//     form:    Mov_Form for mov, index into formatList for the common instructions.
+//     variant: Which of the three common formats matched, -1 if it only has one.
+struct Opcode_Entry {
+	Decode_Proc decode = nullptr;
+	Exec_Proc exec = nullptr;
+	Instruction_Type type = Inst_None;
+	u8 form = 0;
+	i8 variant = -1;
+
+	// The procs follow from the rest, and comparing function pointers isn't
+	// something every compiler takes as a constant expression.
+	constexpr bool operator==(Opcode_Entry const& other) const {
+		return type == other.type && form == other.form && variant == other.variant;
+	}
+};
+
+// Expects to be indexed as primary[byte], or as extended[byte][REG] when
+// hasRegExtension[byte] is set (e.g. 0x80-0x83, 0xF6/0xF7, 0xD0-0xD3).
+struct Opcode_Table {
+	Opcode_Entry primary[256];
+	Opcode_Entry extended[256][8];
+	bool hasRegExtension[256];
+};
+
+extern const Opcode_Table gOpcodeTable;
+
+// The same tables the other way around, for the encoder: the lowest first byte
+// (so D, W, S and V cleared) and REG that decode as an instruction with a layout.
+struct Opcode_Encoding {
+	u8 byte;
+	u8 REG;
+	bool valid;
+};
+
+struct Opcode_Encoding_Table {
+	Opcode_Encoding entries[Inst_Count][static_cast<u8>(Decode_Layout::Count)];
+};
+
+extern const Opcode_Encoding_Table gOpcodeEncodings;
+
+// How long an instruction is from its first byte (and REG, for the group
+// opcodes), without decoding it. Each entry packs the length without the
+// displacement, 0 if it isn't an instruction, with whether a ModRM byte
+// follows (and so a displacement may too) and whether REG changes the rest.
+#define OPCODE_LENGTH_BASE_MASK 0x07
+#define OPCODE_LENGTH_MODRM     0x08
+#define OPCODE_LENGTH_EXTENDED  0x10
+
+struct Opcode_Length_Table {
+	u8 primary[256];
+	u8 extended[256][8];
+};
+
+extern const Opcode_Length_Table gOpcodeLengths;
+
+// Doesn't consume the ModRM byte, the decode procs read it themselves.
+force_inline inline Opcode_Entry const& lookupOpcode(Decoder_Context const& decoder, u8 const byte) {
+	if (!gOpcodeTable.hasRegExtension[byte] || decoder.bytesRead >= decoder.binaryBytes.count) {
+		return gOpcodeTable.primary[byte];
+	}
+	u8 const REG = (decoder.binaryBytes.ptr[decoder.bytesRead] >> 3) & 0b111;
+	return gOpcodeTable.extended[byte][REG];
+}
+
+// Decodes the instruction at decoder.bytesRead, returns nullptr if its first byte isn't recognized
+// or it's cut off by the end of the bytes. Either way bytesRead is one past where it starts.
+Opcode_Entry const* decodeNext(Decoder_Context& decoder, Decoded_Instruction& decoded);
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "decoder.h"
+
+// Instructions as they're kept around in bulk. An Instruction takes 22 bytes
+// and a Decoded_Instruction 36, mostly padding around the unions of the
+// operands, while everything in them fits in 8 and 16 bytes (the latter is
+// Packed_Decoded_Instruction in instruction_stream.h):
+//
+//     Packed_Instruction: type:6 | dst:25 | src:25, in a u64.
+//     Packed_Operand:     Instruction_Operand_Type:3 | payload:22, where the payload is
+//                         Register:           type:4 | usage:2
+//                         RegisterPair:       a:6 | b:6
+//                         Immediate:          value:16 | wide:1
+//                         EffectiveAddress:   base:4 | displacement:17 | wide:1
+//                         Jump:               offset:8
+//     Packed_Fields:      layout:3 | MOD:2 | REG:3 | R/M:3 | D | W | V | has_V | has_W
+//
+// A byte immediate keeps its byte in the low 8 bits of value, with the high 8
+// bits at 0, the same as makeImmediateByte() leaves them.
+
+#define PACKED_TYPE_BITS    6
+#define PACKED_OPERAND_BITS 25
+#define PACKED_OPERAND_MASK ((1u << PACKED_OPERAND_BITS) - 1)
+
+static_assert(Inst_Count <= (1 << PACKED_TYPE_BITS));
+static_assert(static_cast<u8>(Instruction_Operand_Type::Jump) < 8);
+
+namespace Packing {
+	force_inline inline u32 packRegister(RegisterInfo const& reg) {
+		return RegToID(reg.type) | (static_cast<u32>(reg.usage) << 4);
+	}
+
+	force_inline inline RegisterInfo unpackRegister(u32 const bits) {
+		return RegisterInfo{.type = IDToReg(bits & 0xF), .usage = static_cast<RegisterUsage>((bits >> 4) & 0b11)};
+	}
+
+	force_inline inline u32 packImmediate(Immediate const& immediate) {
+		u16 const value = immediate.wide ? cast(u16)immediate.word : cast(u8)immediate.byte;
+		return value | (cast(u32)immediate.wide << 16);
+	}
+
+	force_inline inline Immediate unpackImmediate(u32 const bits) {
+		bool const wide = (bits >> 16) & 1;
+		Immediate immediate = makeImmediateWord(0);
+		immediate.word = cast(i16)(bits & 0xFFFF);
+		immediate.wide = wide;
+		return immediate;
+	}
+
+	inline u32 packOperand(Instruction_Operand const& operand) {
+		using Type = Instruction_Operand_Type;
+		u32 payload = 0;
+		switch (operand.type) {
+			case Type::None: break;
+			case Type::Register:     payload = packRegister(operand.reg); break;
+			case Type::RegisterPair: payload = packRegister(operand.reg_pair.a) | (packRegister(operand.reg_pair.b) << 6); break;
+			case Type::Immediate:    payload = packImmediate(operand.immediate); break;
+			case Type::EffectiveAddress: {
+				payload = static_cast<u32>(operand.address.base) |
+				          (packImmediate(operand.address.displacement) << 4) |
+				          (cast(u32)operand.address.wide << 21);
+			} break;
+			case Type::Jump: payload = cast(u8)operand.jump_offset; break;
+			default: unreachable();
+		}
+		return static_cast<u32>(operand.type) | (payload << 3);
+	}
+
+	inline Instruction_Operand unpackOperand(u32 const bits) {
+		using Type = Instruction_Operand_Type;
+		Instruction_Operand operand = InstOpNone;
+		operand.type = static_cast<Type>(bits & 0b111);
+		u32 const payload = bits >> 3;
+		switch (operand.type) {
+			case Type::None: break;
+			case Type::Register:     operand.reg = unpackRegister(payload); break;
+			case Type::RegisterPair: operand.reg_pair = {unpackRegister(payload), unpackRegister(payload >> 6)}; break;
+			case Type::Immediate:    operand.immediate = unpackImmediate(payload); break;
+			case Type::EffectiveAddress: {
+				operand.address = EffectiveAddress::Info{
+					.base = static_cast<EffectiveAddress::Base>(payload & 0xF),
+					.displacement = unpackImmediate(payload >> 4),
+					.wide = cast(bool)((payload >> 21) & 1),
+				};
+			} break;
+			case Type::Jump: operand.jump_offset = cast(Jumps::Offset)(payload & 0xFF); break;
+			default: unreachable();
+		}
+		return operand;
+	}
+}
+
+struct Packed_Instruction {
+	u64 bits;
+
+	static Packed_Instruction pack(Instruction const& inst) {
+		return Packed_Instruction{
+			static_cast<u64>(inst.type) |
+			(cast(u64)Packing::packOperand(inst.dst) << PACKED_TYPE_BITS) |
+			(cast(u64)Packing::packOperand(inst.src) << (PACKED_TYPE_BITS + PACKED_OPERAND_BITS))
+		};
+	}
+
+	[[nodiscard]] Instruction_Type type() const {
+		return static_cast<Instruction_Type>(bits & ((1u << PACKED_TYPE_BITS) - 1));
+	}
+
+	[[nodiscard]] Instruction_Operand dst() const {
+		return Packing::unpackOperand((bits >> PACKED_TYPE_BITS) & PACKED_OPERAND_MASK);
+	}
+
+	[[nodiscard]] Instruction_Operand src() const {
+		return Packing::unpackOperand((bits >> (PACKED_TYPE_BITS + PACKED_OPERAND_BITS)) & PACKED_OPERAND_MASK);
+	}
+
+	[[nodiscard]] Instruction unpack() const {
+		return Instruction{.dst = dst(), .src = src(), .type = type()};
+	}
+};
+static_assert(sizeof(Packed_Instruction) == 8);
@@ -0,0 +1,84 @@
+#include "parallel_sweep.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "opcode_table.h"
+#include "instruction_lengths.h"
+
+// What one thread decoded, starting at begin as if an instruction was there.
+struct Sweep_Chunk {
+	u32 begin, end;
+	std::vector<Packed_Decoded_Instruction> items;  // Every one of them starts before end.
+	u32 stoppedAt;     // Where the instruction after the last one starts.
+	bool unrecognized; // The byte at stoppedAt isn't an instruction.
+};
+
+static void sweepChunk(Slice<u8> const& binaryBytes, Sweep_Chunk& chunk) {
+	Decoder_Context decoder(binaryBytes);
+	decoder.bytesRead = chunk.begin;
+	while (decoder.bytesRead < chunk.end) {
+		// A wrong guess can run into an instruction cut off by the end of the
+		// binary, which isn't an unrecognized byte, so the last few bytes are
+		// left for when it's known where the instructions really are.
+		if (binaryBytes.count - decoder.bytesRead < MAX_BYTES_PER_INSTRUCTION_8086) break;
+
+		Decoded_Instruction decoded;
+		if (decodeNext(decoder, decoded) == nullptr) {
+			decoder.bytesRead--;
+			chunk.unrecognized = true;
+			break;
+		}
+		chunk.items.push_back(Packed_Decoded_Instruction::pack(decoded));
+		decoder.resetByteStack();
+	}
+	chunk.stoppedAt = decoder.bytesRead;
+}
+
+bool decodeProgramParallel(Slice<u8> const binaryBytes, Instruction_Stream& stream, u32 const threadCount) {
+	size_t const chunkCount = Min(cast(size_t)threadCount, binaryBytes.count / PARALLEL_SWEEP_MIN_CHUNK_SIZE);
+	if (chunkCount <= 1) {
+		return decodeProgram(binaryBytes, stream);
+	}
+
+	std::vector<Sweep_Chunk> chunks(chunkCount);
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < chunkCount; i++) {
+		chunks[i].begin = binaryBytes.count * i / chunkCount;
+		chunks[i].end = binaryBytes.count * (i + 1) / chunkCount;
+		threads.emplace_back(sweepChunk, std::cref(binaryBytes), std::ref(chunks[i]));
+	}
+	for (std::thread& thread: threads) {
+		thread.join();
+	}
+
+	Decoder_Context decoder(binaryBytes);
+	for (Sweep_Chunk const& chunk: chunks) {
+		// decoder.bytesRead is always where a real instruction starts.
+		auto synced = chunk.items.begin();
+		while (decoder.bytesRead < chunk.end) {
+			synced = std::lower_bound(synced, chunk.items.end(), decoder.bytesRead,
+				[](Packed_Decoded_Instruction const& decoded, i64 const offset) { return decoded.offset < offset; });
+			if (synced != chunk.items.end() && synced->offset == decoder.bytesRead) {
+				stream.items.insert(stream.items.end(), synced, chunk.items.end());
+				synced = chunk.items.end();
+				decoder.bytesRead = chunk.stoppedAt;
+				if (chunk.unrecognized) {
+					stream.unrecognizedOffset = chunk.stoppedAt;
+					return false;
+				}
+				continue;
+			}
+
+			Decoded_Instruction decoded;
+			if (decodeNext(decoder, decoded) == nullptr) {
+				stream.unrecognizedOffset = decoder.bytesRead - 1;
+				stream.truncated = isTruncatedAt(binaryBytes, stream.unrecognizedOffset);
+				return false;
+			}
+			stream.push(decoded);
+			decoder.resetByteStack();
+		}
+	}
+	return true;
+}
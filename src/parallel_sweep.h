@@ -0,0 +1,16 @@
+#pragma once
+
+#include "instruction_stream.h"
+
+// Decodes a big binary on several threads, giving exactly what decodeProgram()
+// gives. The binary is split into chunks and each thread decodes one from its
+// first byte, without knowing whether an instruction really starts there.
+// Those guesses are joined in order: the previous chunk says where the next
+// real instruction starts, and once that offset shows up in the next chunk's
+// guess the two have synchronized and the rest of it can be taken as is.
+// The few instructions before that are decoded again from the right offset.
+
+// Smaller binaries aren't worth the threads, they're decoded by decodeProgram().
+#define PARALLEL_SWEEP_MIN_CHUNK_SIZE (64 * 1024)
+
+bool decodeProgramParallel(Slice<u8> binaryBytes, Instruction_Stream& stream, u32 threadCount);
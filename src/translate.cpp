@@ -0,0 +1,414 @@
+#include "translate.h"
+
+#include "formatter.h"
+#include "interpreter.h"
+
+enum struct Translation : u8 { None, Nop, Binary, Jump };
+
+// Goes by the handler -run would give the instruction.
+static Translation getTranslation(Instruction const& inst) {
+	if (IsInstJump(inst.type)) {
+		return Translation::Jump;
+	}
+	switch (inst.type) {
+		case Inst_mov: case Inst_add: case Inst_sub: case Inst_cmp: case Inst_lea: break;
+		default: return Translation::None;
+	}
+	if (!IsBinaryInstTypeOrderValid(inst)) {
+		return Translation::Nop;
+	}
+	Operand_Kind const dst = getOperandKind(inst.dst);
+	Operand_Kind const src = getOperandKind(inst.src);
+	if (dst == Operand_Kind::None || dst == Operand_Kind::Imm || src == Operand_Kind::None ||
+	    (isMem(dst) && isMem(src)) || (inst.type == Inst_lea && !isMem(src))) {
+		return Translation::None;
+	}
+	return Translation::Binary;
+}
+
+static const char* getRegisterLocal(RegisterInfo const& reg) {
+	return RegisterNames[RegToID(reg.type)];
+}
+
+// Sign extended, the same as lowerOperand() leaves it.
+static u32 getImmediateValue(Immediate const& immediate) {
+	return cast(u32)(immediate.wide ? immediate.word : immediate.byte);
+}
+
+static void printAddress(FILE* const out, EffectiveAddress::Info const& address) {
+	using Base = EffectiveAddress::Base;
+	u32 const displacement = getImmediateValue(address.displacement);
+	fprintf(out, "\t\tu32 const address = ");
+	switch (address.base) {
+		case Base::bx_si: fprintf(out, "(u32)bx + si + "); break;
+		case Base::bx_di: fprintf(out, "(u32)bx + di + "); break;
+		case Base::bp_si: fprintf(out, "(u32)bp + si + "); break;
+		case Base::bp_di: fprintf(out, "(u32)bp + di + "); break;
+		case Base::si:    fprintf(out, "(u32)si + "); break;
+		case Base::di:    fprintf(out, "(u32)di + "); break;
+		case Base::bp:    fprintf(out, "(u32)bp + "); break;
+		case Base::bx:    fprintf(out, "(u32)bx + "); break;
+		case Base::Direct: break;
+		default: unreachable();
+	}
+	fprintfln(out, "0x%Xu;", displacement);
+}
+
+static void printRead(FILE* const out, Instruction_Operand const& operand) {
+	switch (getOperandKind(operand)) {
+		case Operand_Kind::Reg8: {
+			const char* const name = getRegisterLocal(operand.reg);
+			fprintf(out, (operand.reg.usage == RegisterUsage::h) ? "(u8)(%s >> 8)" : "(u8)%s", name);
+		} break;
+		case Operand_Kind::Reg16: fprintf(out, "%s", getRegisterLocal(operand.reg)); break;
+		case Operand_Kind::Mem8:  fprintf(out, "memory[address]"); break;
+		case Operand_Kind::Mem16: fprintf(out, "read16(memory, address)"); break;
+		case Operand_Kind::Imm:   fprintf(out, "0x%Xu", getImmediateValue(operand.immediate)); break;
+		default: unreachable();
+	}
+}
+
+static void printWrite(FILE* const out, Instruction_Operand const& operand, const char* const value) {
+	switch (getOperandKind(operand)) {
+		case Operand_Kind::Reg8: {
+			const char* const name = getRegisterLocal(operand.reg);
+			if (operand.reg.usage == RegisterUsage::h) {
+				fprintfln(out, "\t\t%s = (u16)((%s & 0x00FF) | ((u8)(%s) << 8));", name, name, value);
+			} else {
+				fprintfln(out, "\t\t%s = (u16)((%s & 0xFF00) | (u8)(%s));", name, name, value);
+			}
+		} break;
+		case Operand_Kind::Reg16: fprintfln(out, "\t\t%s = (u16)(%s);", getRegisterLocal(operand.reg), value); break;
+		case Operand_Kind::Mem8:  fprintfln(out, "\t\tmemory[address] = (u8)(%s);", value); break;
+		case Operand_Kind::Mem16: fprintfln(out, "\t\twrite16(memory, address, (u16)(%s));", value); break;
+		default: unreachable();
+	}
+}
+
+// The condition as a C++ expression, with loop and friends counting cx down first.
+static const char* getJumpCondition(Instruction_Type const type) {
+	switch (type) {
+		case Inst_jo:  return "getBit(OF)";
+		case Inst_jno: return "!getBit(OF)";
+		case Inst_jb:  return "getBit(CF)";
+		case Inst_jnb: return "!getBit(CF)";
+		case Inst_je:  return "getBit(ZF)";
+		case Inst_jne: return "!getBit(ZF)";
+		case Inst_jbe: return "(getBit(ZF) || getBit(CF))";
+		case Inst_ja:  return "!(getBit(ZF) || getBit(CF))";
+		case Inst_js:  return "getBit(SF)";
+		case Inst_jns: return "!getBit(SF)";
+		case Inst_jp:  return "getBit(PF)";
+		case Inst_jnp: return "!getBit(PF)";
+		case Inst_jl:  return "(getBit(OF) != getBit(SF))";
+		case Inst_jnl: return "(getBit(OF) == getBit(SF))";
+		case Inst_jle: return "(getBit(OF) != getBit(SF) || getBit(ZF))";
+		case Inst_jg:  return "!(getBit(OF) != getBit(SF) || getBit(ZF))";
+		case Inst_loop:   return "--cx != 0";
+		case Inst_loopz:  return "(--cx != 0 && getBit(ZF))";
+		case Inst_loopnz: return "(--cx != 0 && !getBit(ZF))";
+		case Inst_jcxz:   return "cx == 0";
+		default: unreachable();
+	}
+}
+
+// The part of the program that doesn't depend on what's being translated, up to the program's bytes.
+static constexpr const char* Translation_Prelude = R"(#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define MEMORY_SIZE (1024 * 1024)
+
+struct Machine {
+	u16 registers[14];  // ax, bx, cx, dx, sp, bp, si, di, cs, ds, ss, es, ip, flags.
+	u64 clocks;
+	u64 instructions;
+	u8 memory[MEMORY_SIZE];
+};
+
+enum Bit : u16 { CF = 0, PF = 2, AF = 4, ZF = 6, SF, OF, IF, DF, TF };
+static constexpr Bit BitList[] = {CF, PF, AF, ZF, SF, OF, IF, DF, TF};
+static constexpr Bit ArithmeticBits[] = {CF, PF, AF, ZF, SF, OF};
+static constexpr u16 ArithmeticMask = (1 << CF) | (1 << PF) | (1 << AF) | (1 << ZF) | (1 << SF) | (1 << OF);
+
+// What the last add, sub or cmp did, the flags get worked out from it when they're read.
+enum Pending_Op : u8 { None = 0, Add, Sub };
+struct Pending {
+	u16 A, B, result;
+	Pending_Op op;
+	bool wide;
+};
+
+static inline bool computeBit(Bit const bit, Pending const& p) {
+	u16 const mask = p.wide ? 0xFFFF : 0xFF;
+	u16 const sign = p.wide ? 0x8000 : 0x80;
+	u16 const A = p.A & mask, B = p.B & mask, result = p.result & mask;
+	bool const add = p.op == Add;
+	switch (bit) {
+		case CF: return add ? ((u32)A + B > mask) : (A < B);
+		case PF: {
+			u8 parity = result & 0xFF;
+			parity ^= parity >> 4;
+			parity ^= parity >> 2;
+			parity ^= parity >> 1;
+			return (parity & 1) == 0;
+		}
+		case AF: return (A ^ B ^ result) & 0x10;
+		case ZF: return result == 0;
+		case SF: return result & sign;
+		case OF: return add ? ((A ^ result) & (B ^ result) & sign)
+		                    : ((A ^ B) & (A ^ result) & sign);
+		default: return false;
+	}
+}
+
+static inline u16 materialize(u16 flags, Pending const& p) {
+	if (p.op == None) return flags;
+	flags &= ~ArithmeticMask;
+	for (Bit const bit: ArithmeticBits) {
+		if (computeBit(bit, p)) flags |= 1 << bit;
+	}
+	return flags;
+}
+
+static inline u16 read16(u8 const* const memory, u32 const address) {
+	return (u16)(memory[address] | (memory[address + 1] << 8));
+}
+
+static inline void write16(u8* const memory, u32 const address, u16 const value) {
+	memory[address + 0] = value & 0xFF;
+	memory[address + 1] = value >> 8;
+}
+
+[[noreturn]] static inline void outOfBounds(u16 const ip, u32 const address) {
+	fprintf(stderr, "Error: The instruction at 0x%04X addresses memory[%u], past the %d bytes there are.\n", ip, address, MEMORY_SIZE);
+	exit(1);
+}
+)";
+
+// What comes after the program's bytes, up to its first block.
+static constexpr const char* Translation_Run = R"(
+static void run(Machine& machine) {
+	memcpy(machine.memory + LoadCS * 16 + LoadIP, Program, ProgramSize);
+	u16 ax = 0, bx = 0, cx = 0, dx = 0, sp = 0, bp = 0, si = 0, di = 0;
+	u16 cs = LoadCS, ds = 0, ss = 0, es = 0, ip = LoadIP, fl = 0;
+	Pending pending = {};
+	u64 clocks = 0, instructions = 0;
+	[[maybe_unused]] u8* const memory = machine.memory;
+	[[maybe_unused]] auto const getBit = [&](Bit const bit) {
+		return (pending.op != None) ? computeBit(bit, pending) : ((fl >> bit) & 1) != 0;
+	};
+)";
+
+static constexpr const char* Translation_Epilogue = R"(
+halt:
+	u16 const registers[14] = {ax, bx, cx, dx, sp, bp, si, di, cs, ds, ss, es, ip, materialize(fl, pending)};
+	memcpy(machine.registers, registers, sizeof(registers));
+	machine.clocks = clocks;
+	machine.instructions = instructions;
+}
+
+int main(int const argc, char** const argv) {
+	long const runs = (argc > 1) ? strtol(argv[1], nullptr, 10) : 1;
+	if (runs < 1) {
+		fprintf(stderr, "Usage: %s [<times to run it>]\n", argv[0]);
+		return 1;
+	}
+	static Machine machine;
+	auto const start = std::chrono::high_resolution_clock::now();
+	for (long i = 0; i < runs; i++) {
+		memset(&machine, 0, sizeof(machine));
+		run(machine);
+	}
+	std::chrono::duration<double> const elapsed = std::chrono::high_resolution_clock::now() - start;
+
+	static const char* const names[14] = {"ax", "bx", "cx", "dx", "sp", "bp", "si", "di", "cs", "ds", "ss", "es", "ip", "fl"};
+	printf("Final registers:\n");
+	for (int i = 0; i < 14; i++) {
+		u16 const value = machine.registers[i];
+		if (value == 0) continue;
+		if (i == 13) {
+			printf("%8s: ", "flags");
+			for (Bit const bit: BitList) {
+				if ((value >> bit) & 1) putchar("C?P?A?ZSOIDT"[bit]);
+			}
+			putchar('\n');
+		} else {
+			printf("%8s: 0x%04x (%d)\n", names[i], value, value);
+		}
+	}
+	double const seconds = elapsed.count() / runs;
+	double const perSecond = (seconds > 0) ? machine.instructions / seconds : 0;
+	printf("Instructions: %" PRIu64 "\n", machine.instructions);
+	printf("Clocks: %" PRIu64 "\n", machine.clocks);
+	printf("Time: %g s (%.2f M instructions/s)\n", seconds, perSecond / 1e6);
+	return 0;
+}
+)";
+
+// Where a jump goes as a statement: the block there, or out of the program.
+// firstIP: What the IP is at the start of the program, the offsets are from there.
+static void printJumpTo(FILE* const out, Control_Flow_Graph const& cfg, i64 const target, u16 const firstIP) {
+	fprintf(out, "ip = 0x%04X; ", cast(u16)(firstIP + target));
+	i32 const block = (target >= 0 && target <= UINT32_MAX) ? cfg.findBlock(cast(u32)target) : BLOCK_NONE;
+	if (block == BLOCK_NONE) {
+		fprintf(out, "goto halt;");
+	} else {
+		fprintf(out, "goto block_%04X;", firstIP + cfg.blocks[block].start);
+	}
+}
+
+static void printInstruction(FILE* const out, Formatter& formatter, Control_Flow_Graph const& cfg, Packed_Decoded_Instruction const& decoded, u16 const firstIP) {
+	Instruction const inst = decoded.inst.unpack();
+	u32 const ip = firstIP + decoded.offset;
+	u32 const nextIP = ip + decoded.size;
+
+	u16 clocks = 0;
+	u8 transfers = 0;
+	Clock_Calculation const calculation = getInstructionClocksCalculation(inst);
+	for (u8 i = 0; i < calculation.part_count; i++) {
+		Clock_Calculation_Part const& part = calculation.parts[i];
+		if (part.type == Clock_16bitTransfer) {
+			transfers = part.transfer.count;
+		} else {
+			clocks += getStaticPartClocks(part);
+		}
+	}
+
+	fprintf(out, "\t{ // ");
+	formatter.printInstText(inst);
+	fputc('\n', out);
+
+	Translation const translation = getTranslation(inst);
+	bool const memory = translation == Translation::Binary && (IsOperandMem(inst.dst) || IsOperandMem(inst.src));
+	if (memory) {
+		printAddress(out, IsOperandMem(inst.dst) ? inst.dst.address : inst.src.address);
+	}
+	fprintf(out, "\t\tclocks += %u; ", clocks);
+	if (transfers > 0) {
+		assertTrue(memory);
+		fprintf(out, "if (address %% 2 == 1) clocks += %u; ", 4 * transfers);
+	}
+	fprintfln(out, "instructions++; ip = 0x%04X;", nextIP);
+
+	switch (translation) {
+		case Translation::Nop: break;
+
+		case Translation::Binary: {
+			Operand_Kind const dst = getOperandKind(inst.dst);
+			bool const wide = dst == Operand_Kind::Reg16 || dst == Operand_Kind::Mem16;
+			if (memory && inst.type != Inst_lea) {
+				bool const memoryWide = IsOperandMem(inst.dst) ? inst.dst.address.wide : inst.src.address.wide;
+				fprintfln(out, "\t\tif (address > MEMORY_SIZE - %d) outOfBounds(0x%04X, address);", memoryWide ? 2 : 1, ip);
+			}
+			if (inst.type == Inst_mov) {
+				fprintf(out, "\t\tu32 const value = ");
+				printRead(out, inst.src);
+				fprintfln(out, ";");
+				printWrite(out, inst.dst, "value");
+			} else if (inst.type == Inst_lea) {
+				printWrite(out, inst.dst, "address");
+			} else {
+				u32 const mask = wide ? 0xFFFF : 0xFF;
+				fprintf(out, "\t\tu32 const A = ");
+				printRead(out, inst.dst);
+				fprintf(out, " & 0x%X;\n\t\tu32 const B = ", mask);
+				printRead(out, inst.src);
+				fprintfln(out, " & 0x%X;", mask);
+				bool const add = inst.type == Inst_add;
+				fprintfln(out, "\t\tu32 const result = (A %c B) & 0x%X;", add ? '+' : '-', mask);
+				fprintfln(out, "\t\tpending = {(u16)A, (u16)B, (u16)result, %s, %s};", add ? "Add" : "Sub", wide ? "true" : "false");
+				if (inst.type != Inst_cmp) {
+					printWrite(out, inst.dst, "result");
+				}
+			}
+		} break;
+
+		case Translation::Jump: {
+			fprintf(out, "\t\tif (%s) { ", getJumpCondition(inst.type));
+			printJumpTo(out, cfg, getJumpTarget(decoded), firstIP);
+			fprintfln(out, " }");
+		} break;
+
+		default: unreachable();
+	}
+	fprintfln(out, "\t}");
+}
+
+bool translateProgram(FILE* const outFile, Slice<u8> const& program, Instruction_Stream const& stream, Control_Flow_Graph const& cfg,
+                      Load_Address const loadAddress, const char* const name) {
+	if (!loadAddress.fits(program.count)) {
+		eprintfln(LOG_ERROR_STRING": The %zu bytes of the program don't fit in memory at %04X:%04X.", program.count, loadAddress.cs, loadAddress.ip);
+		return false;
+	}
+	u32 const programSize = cast(u32)program.count;
+	for (Packed_Decoded_Instruction const& decoded: stream.items) {
+		Instruction const inst = decoded.inst.unpack();
+		const char* problem = nullptr;
+		if (getTranslation(inst) == Translation::None) {
+			problem = "only mov, add, sub, cmp, lea and the jumps can be translated";
+		} else if (IsInstJump(inst.type)) {
+			i64 const target = getJumpTarget(decoded);
+			if (target >= 0 && target < programSize && cfg.findBlock(cast(u32)target) == BLOCK_NONE) {
+				problem = "it jumps into the middle of an instruction";
+			}
+		}
+		if (problem != nullptr) {
+			Formatter formatter(stderr, false, false);
+			eprintf(LOG_ERROR_STRING": Can't translate `");
+			formatter.printInstText(inst);
+			eprintfln("` at offset %u, %s.", decoded.offset, problem);
+			return false;
+		}
+	}
+
+	// Only the blocks something jumps to get a label, an unused one would be a warning.
+	std::vector<bool> isTarget(cfg.blocks.size(), false);
+	for (Basic_Block const& block: cfg.blocks) {
+		if (block.taken != BLOCK_NONE) {
+			isTarget[block.taken] = true;
+		}
+	}
+
+	fprintfln(outFile, "// %s, translated to C++ by Sim86's -translate.", name);
+	fprintfln(outFile, "// It runs the same way as with -run, and an argument runs it that many times.");
+	fputc('\n', outFile);
+	fputs(Translation_Prelude, outFile);
+
+	// The bytes go in memory too, so reading them as data works like with -run.
+	fprintfln(outFile, "\nstatic constexpr u16 LoadCS = 0x%04X, LoadIP = 0x%04X;", loadAddress.cs, loadAddress.ip);
+	fprintfln(outFile, "static constexpr u32 ProgramSize = %u;", programSize);
+	fprintf(outFile, "static const u8 Program[%u] = {", Max(programSize, 1u));
+	for (u32 i = 0; i < programSize; i++) {
+		fprintf(outFile, (i % 16 == 0) ? "\n\t0x%02X," : " 0x%02X,", program.ptr[i]);
+	}
+	fprintfln(outFile, "\n};");
+	fputs(Translation_Run, outFile);
+
+	Formatter formatter(outFile, false, false);
+	u16 const firstIP = loadAddress.ip;
+	for (size_t b = 0; b < cfg.blocks.size(); b++) {
+		Basic_Block const& block = cfg.blocks[b];
+		fprintfln(outFile, "\n\t// block %zu (0x%04X)", b, firstIP + block.start);
+		if (isTarget[b]) {
+			fprintfln(outFile, "block_%04X:", firstIP + block.start);
+		}
+		for (u32 i = block.first; i < block.first + block.count; i++) {
+			printInstruction(outFile, formatter, cfg, stream.items[i], firstIP);
+		}
+		if (block.next == BLOCK_NONE) {
+			fprintfln(outFile, "\tgoto halt;");
+		}
+	}
+
+	fputs(Translation_Epilogue, outFile);
+	return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "control_flow.h"
+
+// Writes a decoded program out as one C++ file that runs it, for -translate.
+//
+// The file needs nothing but the standard library. Every basic block becomes
+// a run of statements in one function, starting at a block_<IP> label
+// when something jumps to it, and every jump a goto. The registers are locals
+// and the flags stay pending the way Machine::pendingFlags keeps them, so the
+// compiler can keep what it likes in host registers. The clocks of each
+// instruction are added up here with getInstructionClocksCalculation(), only
+// the odd address penalty is left for when the address is known.
+//
+// When it runs it prints the final registers, instructions and clocks the way
+// -run does, and how long it took. An argument runs it that many times.
+//
+// Only the instructions -run has handlers of its own for can be translated:
+// mov, add, sub, cmp, lea and the jumps.
+
+// The program's bytes get loaded at loadAddress when it runs, same as with -run,
+// so CS:IP starts out there and the IPs it leaves count from there. What runs
+// is what was translated though, a program writing over its own code only
+// changes the bytes.
+//
+// Returns false without writing anything, having said why, if some instruction
+// can't be translated or the program doesn't fit at loadAddress.
+bool translateProgram(FILE* outFile, Slice<u8> const& program, Instruction_Stream const& stream, Control_Flow_Graph const& cfg,
+                      Load_Address loadAddress, const char* name);